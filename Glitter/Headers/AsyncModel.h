@@ -0,0 +1,172 @@
+#ifndef ASYNC_MODEL_H
+#define ASYNC_MODEL_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "Material.h"
+#include "model.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// milliseconds of mesh uploads per frame while a model streams in
+const double MODEL_UPLOAD_BUDGET_MS = 2.0;
+
+// a model loaded in the background. the constructor returns at once, importing (or reading the mesh cache)
+// and optimizing run on the thread pool. update() then uploads the meshes a few per frame and swaps the
+// model in when the last one is on the GPU, so model() is either NULL or complete, never half uploaded.
+// meanwhile proxy() is a box around the imported meshes to draw in its place.
+class AsyncModel
+{
+public:
+    AsyncModel(string const& path, bool gamma = false, VertexFormat format = VertexFormat::compact())
+        : building(new Model(format, gamma)), import(new Import())
+    {
+        building->directory = Model::directoryOf(path);
+        shared_ptr<Import> state = import;
+        ThreadPool::shared().enqueue([state, path]() {
+            state->ok = Model::importMeshes(path, state->data);
+            state->done = true;
+        });
+    }
+
+    // uploads imported meshes for at most budgetMs (at least one mesh per call) and swaps the model in
+    // once complete. GL thread only, once per frame.
+    void update(double budgetMs = MODEL_UPLOAD_BUDGET_MS)
+    {
+        if (finished || failed || !import->done)
+            return;
+        vector<MeshData>& data = import->data;
+        if (!import->ok || data.empty())
+        {
+            cout << "ERROR::ASYNC_MODEL:: nothing to load" << endl;
+            failed = true;
+            return;
+        }
+        if (!box)
+            buildProxy(data);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (building->meshes.empty())
+            building->meshes.reserve(data.size());
+        while (building->meshes.size() < data.size())
+        {
+            building->meshes.push_back(building->createMesh(data[building->meshes.size()]));
+            if (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= budgetMs)
+                break;
+        }
+        if (building->meshes.size() < data.size())
+            return;
+
+        finished = move(building);
+        data.clear();
+        data.shrink_to_fit();
+    }
+
+    // true once the model is completely uploaded
+    bool ready() const
+    {
+        return finished != NULL;
+    }
+
+    bool loadFailed() const
+    {
+        return failed;
+    }
+
+    // the finished model, NULL while loading
+    Model* model() const
+    {
+        return finished.get();
+    }
+
+    // a box to draw while the meshes upload, NULL before the import finished and once the model is ready
+    Model* proxy() const
+    {
+        return finished ? NULL : box.get();
+    }
+
+    // frees the box and its buffers once the model is ready. call after the renderer has switched to
+    // model(), it may still hold on to the box until then.
+    void releaseProxy()
+    {
+        if (finished)
+            box.reset();
+    }
+
+    // fraction of the meshes uploaded
+    float progress() const
+    {
+        if (finished)
+            return 1.0f;
+        if (!import->done || import->data.empty())
+            return 0.0f;
+        return static_cast<float>(building->meshes.size()) / import->data.size();
+    }
+
+private:
+    // written by the import job, read by the GL thread once done is set
+    struct Import {
+        atomic<bool>     done;
+        bool             ok = false;
+        vector<MeshData> data;
+        Import() : done(false) {}
+    };
+
+    unique_ptr<Model>  building; // receives the uploads, swapped into finished when complete
+    unique_ptr<Model>  finished;
+    unique_ptr<Model>  box;      // stays around until releaseProxy(), the renderer may still hold on to it
+    shared_ptr<Import> import;   // shared with the job, which may outlive us
+    bool               failed = false;
+
+    // the box of every vertex of the model as one flat shaded mesh
+    void buildProxy(const vector<MeshData>& data)
+    {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        bool first = true;
+        for (size_t m = 0; m < data.size(); m++)
+            for (size_t i = 0; i < data[m].vertices.size(); i++)
+            {
+                const glm::vec3& p = data[m].vertices[i].Position;
+                lo = first ? p : glm::min(lo, p);
+                hi = first ? p : glm::max(hi, p);
+                first = false;
+            }
+
+        // corner c has x from bit 0, y from bit 1, z from bit 2. faces wind counter-clockwise from outside.
+        static const int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+        static const float normals[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        for (int f = 0; f < 6; f++)
+        {
+            unsigned int base = static_cast<unsigned int>(vertices.size());
+            glm::vec3 n(normals[f][0], normals[f][1], normals[f][2]);
+            for (int k = 0; k < 4; k++)
+            {
+                int c = faces[f][k];
+                Vertex v = Vertex();
+                v.Position = glm::vec3(c & 1 ? hi.x : lo.x, c & 2 ? hi.y : lo.y, c & 4 ? hi.z : lo.z);
+                v.Normal = n;
+                v.FaceNormal = n;
+                vertices.push_back(v);
+            }
+            unsigned int quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+
+        box.reset(new Model(building->format, building->gammaCorrection));
+        Mesh mesh(move(vertices), move(indices), vector<Texture>(), building->format);
+        mesh.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+        mesh.diffuse_map = false;
+        mesh.material = MaterialTable::instance().add(mesh.textures, mesh.diffuse, mesh.diffuse_map);
+        box->meshes.push_back(move(mesh));
+    }
+};
+#endif
@@ -0,0 +1,203 @@
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "FrameCapture.h"
+#include "model.h"
+#include "SceneRenderer.h"
+#include "TextureBuffer.h"
+#include "TextureStreamer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// one image of a batch: a model seen from a camera in one of the view modes
+struct BatchJob {
+    string    model;
+    int       width = 800;
+    int       height = 600;
+    int       view = RENDER_VIEW_GOOCH;
+    glm::vec3 position = glm::vec3(-10.0f, 10.0f, 20.0f); // where the interactive camera starts
+    float     yaw = YAW;
+    float     pitch = PITCH;
+    float     zoom = ZOOM;
+    string    output;
+};
+
+// renders the images a manifest lists, without a window. the manifest is a text file of commands, one per
+// line, each setting what the following images use until it's given again:
+//
+//     # comment
+//     model resources/A-Wing Starfighter.obj
+//     size 800 600
+//     view gooch                       (normal-edges, depth-edges, face-normals, depth, diffuse, or 0-5)
+//     camera -10 10 20 -90 0 45        (position, yaw and pitch in degrees, optionally the field of view)
+//     render out/awing.png             (draws an image with the above and writes it as a png)
+//
+// relative paths are relative to the manifest. consecutive images of the same model share it, and the
+// programs and targets are shared by all of them, so list the images of a model together. images are
+// read back and encoded by a FrameCapture while the next ones render.
+class BatchRenderer
+{
+public:
+    vector<BatchJob> jobs;
+
+    // reads the manifest's jobs, false with a message on the first line that doesn't parse
+    bool load(const string& manifest)
+    {
+        ifstream file(manifest.c_str());
+        if (!file)
+        {
+            cout << "ERROR::BATCH:: can't read " << manifest << endl;
+            return false;
+        }
+        string base = directoryOf(manifest);
+        BatchJob job;
+        string line;
+        for (int number = 1; getline(file, line); number++)
+        {
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+            istringstream in(line);
+            string command;
+            if (!(in >> command) || command[0] == '#')
+                continue;
+            // what's left of the line, paths may have spaces
+            string rest;
+            getline(in >> ws, rest);
+
+            bool ok = true;
+            if (command == "model")
+                job.model = resolve(base, rest);
+            else if (command == "render")
+            {
+                job.output = resolve(base, rest);
+                ok = !job.model.empty() && !rest.empty();
+                if (ok)
+                    jobs.push_back(job);
+            }
+            else if (command == "size")
+                ok = static_cast<bool>(istringstream(rest) >> job.width >> job.height) && job.width > 0 && job.height > 0;
+            else if (command == "view")
+                ok = parseView(rest, job.view);
+            else if (command == "camera")
+            {
+                istringstream values(rest);
+                ok = static_cast<bool>(values >> job.position.x >> job.position.y >> job.position.z >> job.yaw >> job.pitch);
+                if (ok && !(values >> job.zoom))
+                    job.zoom = ZOOM;
+            }
+            else
+                ok = false;
+            if (!ok)
+            {
+                cout << "ERROR::BATCH:: " << manifest << ":" << number << ": can't use \"" << line << "\"" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // renders every job with renderer and hue, returns how many failed. the context has to be current.
+    int run(SceneRenderer& renderer, const Hue& hue, FrameCapture& capture)
+    {
+        // the model matrix of the interactive view
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+
+        unique_ptr<Model>         scene;
+        string                    loaded;
+        unique_ptr<TextureBuffer> target;
+        int failed = 0;
+        double loading = 0.0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            const BatchJob& job = jobs[i];
+            if (job.model != loaded)
+            {
+                chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+                // the previous model goes first, its materials and textures with it
+                renderer.setScene(NULL);
+                scene.reset();
+                loaded = job.model;
+                scene.reset(new Model(job.model));
+                TextureStreamer::instance().flush();
+                if (scene->meshes.empty())
+                    scene.reset();
+                renderer.setScene(scene.get());
+                loading += elapsed(begin);
+            }
+            if (!scene)
+            {
+                cout << "ERROR::BATCH:: nothing to draw for " << job.output << endl;
+                failed++;
+                continue;
+            }
+
+            if (!target || target->width != job.width || target->height != job.height)
+            {
+                target.reset(new TextureBuffer(job.width, job.height, false, GL_RGBA8));
+                renderer.graph.setBackbuffer(target->FBO);
+            }
+            Camera camera(job.position, glm::vec3(0.0f, 1.0f, 0.0f), job.yaw, job.pitch);
+            camera.Zoom = job.zoom;
+            renderer.render(job.view, model, camera, hue, job.width, job.height);
+            capture.capture(*target, job.output);
+            capture.poll();
+        }
+        capture.finish();
+        failed += static_cast<int>(capture.failed());
+
+        double total = elapsed(start), rendering = total - loading;
+        size_t images = capture.written();
+        cout << "batch: " << images << " of " << jobs.size() << " images in " << total << " s, "
+             << loading << " s loading, " << rendering << " s rendering (" << (rendering > 0.0 ? images / rendering : 0.0)
+             << " frames/s)" << endl;
+        renderer.setScene(NULL);
+        return failed;
+    }
+
+    // the directory a path is in, "." for a bare file name. either separator.
+    static string directoryOf(const string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == string::npos ? string(".") : path.substr(0, slash);
+    }
+
+private:
+    static string resolve(const string& base, const string& path)
+    {
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+        return absolute || path.empty() ? path : base + "/" + path;
+    }
+
+    static bool parseView(const string& name, int& view)
+    {
+        static const char* names[] = { "gooch", "normal-edges", "depth-edges", "face-normals", "depth", "diffuse" };
+        for (int i = 0; i < static_cast<int>(sizeof(names) / sizeof(names[0])); i++)
+            if (name == names[i] || name == to_string(i))
+            {
+                view = i;
+                return true;
+            }
+        return false;
+    }
+
+    static double elapsed(chrono::steady_clock::time_point since)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - since).count();
+    }
+};
+#endif
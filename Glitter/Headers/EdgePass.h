@@ -0,0 +1,71 @@
+#ifndef EDGE_PASS_H
+#define EDGE_PASS_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "shader.h"
+
+// side of the tiles edges.cs works on, keep in sync with its local size
+const int EDGE_TILE = 16;
+
+// the outline masks from the G-buffer's face normals and depth buffer in one pass: normal edges in red,
+// depth edges in green. with a compute program (4.3 contexts) every texel is fetched once per
+// tile, otherwise a full-screen quad samples its 9 neighbours.
+class EdgePass
+{
+public:
+    // compute may be NULL, or one that didn't link, then the fragment path is used
+    EdgePass(const Shader& fragment, const Shader* compute) : fragment(fragment), compute(compute)
+    {
+        if (this->compute && !this->compute->linked())
+            this->compute = NULL;
+        bindSamplers(fragment);
+        if (this->compute)
+            bindSamplers(*this->compute);
+    }
+
+    static bool computeAvailable()
+    {
+        return GLAD_GL_VERSION_4_3 != 0;
+    }
+
+    bool usesCompute() const
+    {
+        return compute != NULL;
+    }
+
+    // writes target (GL_RG8, as large as the inputs). the fragment path draws into the bound framebuffer,
+    // which has to be target's.
+    void run(GLuint faceNormals, GLuint depths, GLuint target, int width, int height, GLuint quadVAO)
+    {
+        GLState& state = GLState::instance();
+        state.bindTexture(0, faceNormals);
+        state.bindTexture(1, depths);
+        if (compute)
+        {
+            compute->use();
+            glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG8);
+            glDispatchCompute((width + EDGE_TILE - 1) / EDGE_TILE, (height + EDGE_TILE - 1) / EDGE_TILE, 1);
+            // the mask is sampled by the passes after this one
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            return;
+        }
+        state.setDepthTest(false);
+        fragment.use();
+        state.bindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+private:
+    const Shader& fragment;
+    const Shader* compute;
+
+    static void bindSamplers(const Shader& shader)
+    {
+        shader.use();
+        shader.setInt("faceNormals", 0);
+        shader.setInt("depths", 1);
+    }
+};
+#endif
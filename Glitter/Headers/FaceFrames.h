@@ -0,0 +1,154 @@
+#ifndef FACE_FRAMES_H
+#define FACE_FRAMES_H
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FACE_FRAMES_SSE2 1
+#endif
+
+// a triangle corner without texture coordinates, see FaceFrames::bitangents
+const unsigned int FACE_FRAMES_NO_UV = ~0u;
+
+// per triangle normals and bitangents for the importers, four triangles at a time. positions (and uvs)
+// come as a structure of arrays, indexed 3 per triangle, and so do the results: one array per component.
+// the SSE2 path and the scalar fallback do the same arithmetic in the same order.
+class FaceFrames
+{
+public:
+    // unit face normals. degenerate triangles get nan, the same glm::normalize gives them.
+    static void normals(const float* x, const float* y, const float* z, const unsigned int* indices, size_t triangles,
+                        float* nx, float* ny, float* nz)
+    {
+        size_t t = 0;
+#ifdef FACE_FRAMES_SSE2
+        for (; t + 4 <= triangles; t += 4)
+        {
+            const unsigned int* i = indices + t * 3;
+            __m128 ax = gather(x, i, 0), ay = gather(y, i, 0), az = gather(z, i, 0);
+            __m128 e1x = _mm_sub_ps(gather(x, i, 1), ax), e1y = _mm_sub_ps(gather(y, i, 1), ay), e1z = _mm_sub_ps(gather(z, i, 1), az);
+            __m128 e2x = _mm_sub_ps(gather(x, i, 2), ax), e2y = _mm_sub_ps(gather(y, i, 2), ay), e2z = _mm_sub_ps(gather(z, i, 2), az);
+            __m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+            __m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+            __m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+            _mm_storeu_ps(nx + t, _mm_div_ps(cx, length));
+            _mm_storeu_ps(ny + t, _mm_div_ps(cy, length));
+            _mm_storeu_ps(nz + t, _mm_div_ps(cz, length));
+        }
+#endif
+        for (; t < triangles; t++)
+        {
+            const unsigned int* i = indices + t * 3;
+            float e1x = x[i[1]] - x[i[0]], e1y = y[i[1]] - y[i[0]], e1z = z[i[1]] - z[i[0]];
+            float e2x = x[i[2]] - x[i[0]], e2y = y[i[2]] - y[i[0]], e2z = z[i[2]] - z[i[0]];
+            float cx = e1y * e2z - e1z * e2y;
+            float cy = e1z * e2x - e1x * e2z;
+            float cz = e1x * e2y - e1y * e2x;
+            float length = sqrt(cx * cx + cy * cy + cz * cz);
+            nx[t] = cx / length;
+            ny[t] = cy / length;
+            nz[t] = cz / length;
+        }
+    }
+
+    // unit bitangents from the uv derivatives. uvIndices are the corners' uvs, FACE_FRAMES_NO_UV where a
+    // corner has none; those triangles and ones with a degenerate mapping get zero. vSign = -1 computes
+    // them in flipped uv space from unflipped uvs.
+    static void bitangents(const float* x, const float* y, const float* z, const unsigned int* indices,
+                           const float* u, const float* v, const unsigned int* uvIndices, float vSign, size_t triangles,
+                           float* bx, float* by, float* bz)
+    {
+        size_t t = 0;
+#ifdef FACE_FRAMES_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(vSign);
+        for (; t + 4 <= triangles; t += 4)
+        {
+            const unsigned int* i = indices + t * 3;
+            // corners without uvs read uv 0 and are masked out at the end
+            unsigned int uvi[12];
+            int missing = 0;
+            for (int c = 0; c < 12; c++)
+            {
+                uvi[c] = uvIndices[t * 3 + c];
+                if (uvi[c] == FACE_FRAMES_NO_UV)
+                {
+                    uvi[c] = 0;
+                    missing |= 1 << (c / 3);
+                }
+            }
+            __m128 ax = gather(x, i, 0), ay = gather(y, i, 0), az = gather(z, i, 0);
+            __m128 e1x = _mm_sub_ps(gather(x, i, 1), ax), e1y = _mm_sub_ps(gather(y, i, 1), ay), e1z = _mm_sub_ps(gather(z, i, 1), az);
+            __m128 e2x = _mm_sub_ps(gather(x, i, 2), ax), e2y = _mm_sub_ps(gather(y, i, 2), ay), e2z = _mm_sub_ps(gather(z, i, 2), az);
+            __m128 u0 = gather(u, uvi, 0), v0 = gather(v, uvi, 0);
+            __m128 du1 = _mm_sub_ps(gather(u, uvi, 1), u0), dv1 = _mm_mul_ps(_mm_sub_ps(gather(v, uvi, 1), v0), sign);
+            __m128 du2 = _mm_sub_ps(gather(u, uvi, 2), u0), dv2 = _mm_mul_ps(_mm_sub_ps(gather(v, uvi, 2), v0), sign);
+            __m128 det = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+            __m128 r = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+            __m128 cx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2x, du1), _mm_mul_ps(e1x, du2)), r);
+            __m128 cy = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2y, du1), _mm_mul_ps(e1y, du2)), r);
+            __m128 cz = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2z, du1), _mm_mul_ps(e1z, du2)), r);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+            __m128 positive = _mm_cmpgt_ps(length, zero);
+            cx = select(positive, _mm_div_ps(cx, length), cx);
+            cy = select(positive, _mm_div_ps(cy, length), cy);
+            cz = select(positive, _mm_div_ps(cz, length), cz);
+
+            __m128 valid = _mm_cmpneq_ps(det, zero);
+            __m128 textured = _mm_castsi128_ps(_mm_setr_epi32(missing & 1 ? 0 : -1, missing & 2 ? 0 : -1, missing & 4 ? 0 : -1, missing & 8 ? 0 : -1));
+            valid = _mm_and_ps(valid, textured);
+            _mm_storeu_ps(bx + t, _mm_and_ps(valid, cx));
+            _mm_storeu_ps(by + t, _mm_and_ps(valid, cy));
+            _mm_storeu_ps(bz + t, _mm_and_ps(valid, cz));
+        }
+#endif
+        for (; t < triangles; t++)
+        {
+            const unsigned int* i = indices + t * 3;
+            const unsigned int* uvi = uvIndices + t * 3;
+            bx[t] = by[t] = bz[t] = 0.0f;
+            if (uvi[0] == FACE_FRAMES_NO_UV || uvi[1] == FACE_FRAMES_NO_UV || uvi[2] == FACE_FRAMES_NO_UV)
+                continue;
+            float e1x = x[i[1]] - x[i[0]], e1y = y[i[1]] - y[i[0]], e1z = z[i[1]] - z[i[0]];
+            float e2x = x[i[2]] - x[i[0]], e2y = y[i[2]] - y[i[0]], e2z = z[i[2]] - z[i[0]];
+            float du1 = u[uvi[1]] - u[uvi[0]], dv1 = (v[uvi[1]] - v[uvi[0]]) * vSign;
+            float du2 = u[uvi[2]] - u[uvi[0]], dv2 = (v[uvi[2]] - v[uvi[0]]) * vSign;
+            float det = du1 * dv2 - du2 * dv1;
+            if (det == 0.0f)
+                continue;
+            float r = 1.0f / det;
+            float cx = (e2x * du1 - e1x * du2) * r;
+            float cy = (e2y * du1 - e1y * du2) * r;
+            float cz = (e2z * du1 - e1z * du2) * r;
+            float length = sqrt(cx * cx + cy * cy + cz * cz);
+            if (length > 0.0f)
+            {
+                cx /= length;
+                cy /= length;
+                cz /= length;
+            }
+            bx[t] = cx;
+            by[t] = cy;
+            bz[t] = cz;
+        }
+    }
+
+private:
+#ifdef FACE_FRAMES_SSE2
+    // corner c of four consecutive triangles
+    static __m128 gather(const float* p, const unsigned int* i, int c)
+    {
+        return _mm_setr_ps(p[i[c]], p[i[3 + c]], p[i[6 + c]], p[i[9 + c]]);
+    }
+
+    static __m128 select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+#endif
+};
+#endif
@@ -0,0 +1,383 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+#include <stb_image_write.h>
+
+#include "GLState.h"
+#include "TextureBuffer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// frames a readback may take before capture() waits for it, and the pixel buffers in the ring
+const unsigned int CAPTURE_RING = 3;
+
+// bytes of frames read back but not on disk yet. capture() waits for the encoders beyond that.
+const size_t CAPTURE_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+enum Capture_Format {
+    CAPTURE_PNG, // a png per frame
+    CAPTURE_Y4M  // appended to the open video, see openVideo
+};
+
+// writes frames to disk without stalling the renderer. capture() reads the framebuffer into the next pixel
+// buffer of a ring and fences it, poll() copies the frames whose fence signalled out of their buffers
+// (usually a frame or two later) and the thread pool encodes them. the render thread only waits when the
+// ring comes around to a readback the GPU hasn't finished, or when more than the memory budget is waiting
+// for the encoders, so capture slows rendering down only as far as the disk and the encoders can't keep up.
+// GL thread only, except for the encoding.
+class FrameCapture
+{
+public:
+    // frames captured, and how often capture() had to wait for the GPU or the encoders
+    struct Stats {
+        size_t captured = 0;
+        size_t waits = 0;
+        size_t stalls = 0;
+    };
+    Stats stats;
+
+    explicit FrameCapture(size_t memoryBudget = CAPTURE_MEMORY_BUDGET) : budget(memoryBudget), shared(new Shared())
+    {
+    }
+
+    ~FrameCapture()
+    {
+        closeVideo();
+        finish();
+        for (unsigned int i = 0; i < CAPTURE_RING; i++)
+            if (ring[i].buffer)
+                glDeleteBuffers(1, &ring[i].buffer);
+    }
+
+    // reads width x height of framebuffer (0 is the window's back buffer) and writes it to path, or appends
+    // it to the video. call after the frame is drawn, before it's swapped.
+    void capture(GLuint framebuffer, int width, int height, const std::string& path, Capture_Format format = CAPTURE_PNG)
+    {
+        if (format == CAPTURE_Y4M && (!video || width != video->width || height != video->height))
+        {
+            std::cout << "ERROR::FRAME_CAPTURE:: no " << width << "x" << height << " video open" << std::endl;
+            return;
+        }
+
+        // the ring came around to a readback that's still in flight
+        Slot& slot = ring[next];
+        if (slot.fence)
+            retire(slot, true);
+
+        size_t bytes = static_cast<size_t>(width) * height * 4;
+        if (!slot.buffer)
+            glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (slot.capacity < bytes)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+            slot.capacity = bytes;
+        }
+        GLState::instance().bindFramebuffer(framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        // into the buffer, returns at once
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        slot.width = width;
+        slot.height = height;
+        slot.path = path;
+        slot.format = format;
+        if (format == CAPTURE_Y4M)
+            slot.sequence = videoFrames++;
+        next = (next + 1) % CAPTURE_RING;
+        stats.captured++;
+    }
+
+    void capture(const TextureBuffer& buffer, const std::string& path, Capture_Format format = CAPTURE_PNG)
+    {
+        capture(buffer.FBO, buffer.width, buffer.height, path, format);
+    }
+
+    // hands the readbacks the GPU finished to the encoders, oldest first. never waits, call once per frame.
+    void poll()
+    {
+        for (unsigned int i = 0; i < CAPTURE_RING; i++)
+        {
+            Slot& slot = ring[(next + i) % CAPTURE_RING];
+            if (!slot.fence)
+                continue;
+            if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            retire(slot, false);
+        }
+    }
+
+    // waits until every captured frame is on disk. these waits are the point of calling it, the stats
+    // don't count them.
+    void finish()
+    {
+        for (unsigned int i = 0; i < CAPTURE_RING; i++)
+        {
+            Slot& slot = ring[(next + i) % CAPTURE_RING];
+            if (slot.fence)
+                retire(slot, true, false);
+        }
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->changed.wait(lock, [this]() { return shared->encoding == 0; });
+    }
+
+    // starts a y4m video the CAPTURE_Y4M frames go to, in the order they were captured. 4:2:0, so width and
+    // height have to be even.
+    bool openVideo(const std::string& path, int width, int height, int fps)
+    {
+        closeVideo();
+        if (width <= 0 || height <= 0 || width % 2 || height % 2)
+        {
+            std::cout << "ERROR::FRAME_CAPTURE:: video frames must have an even size, not " << width << "x" << height << std::endl;
+            return false;
+        }
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::FRAME_CAPTURE:: can't write " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+        video.reset(new Video());
+        video->file = file;
+        video->width = width;
+        video->height = height;
+        videoFrames = 0;
+        return true;
+    }
+
+    // waits for the video's frames and closes it
+    void closeVideo()
+    {
+        if (!video)
+            return;
+        finish();
+        fclose(video->file);
+        video.reset();
+    }
+
+    bool recording() const
+    {
+        return video != NULL;
+    }
+
+    // frames on disk and frames that couldn't be written. a video frame counts once it's in the file, or
+    // skipped, not while it waits for earlier ones.
+    size_t written() const
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->written;
+    }
+
+    size_t failed() const
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->failed;
+    }
+
+    void report() const
+    {
+        std::cout << "frame capture: " << stats.captured << " frames, " << written() << " written, " << failed()
+                  << " failed, waited " << stats.waits << " times for the GPU and " << stats.stalls
+                  << " times for the encoders" << std::endl;
+    }
+
+private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    struct Slot {
+        GLuint         buffer = 0;
+        size_t         capacity = 0;
+        GLsync         fence = 0;
+        int            width = 0;
+        int            height = 0;
+        std::string    path;
+        Capture_Format format = CAPTURE_PNG;
+        size_t         sequence = 0; // of the video frames
+    };
+
+    // frames encoded but waiting for earlier ones, so the file gets them in order
+    struct Video {
+        std::mutex mutex; // of the file and ready, writes don't hold up capture()
+        FILE*      file = NULL;
+        int        width = 0;
+        int        height = 0;
+        size_t     written = 0; // frames in the file
+        std::map<size_t, std::vector<unsigned char> > ready;
+    };
+
+    // shared with the encode jobs
+    struct Shared {
+        mutable std::mutex      mutex;
+        std::condition_variable changed;
+        size_t                  bytes = 0;    // frames read back and not written yet
+        size_t                  encoding = 0; // jobs queued or running
+        size_t                  written = 0;
+        size_t                  failed = 0;
+    };
+
+    Slot                    ring[CAPTURE_RING];
+    unsigned int            next = 0; // the slot the next capture uses, the oldest one in flight
+    size_t                  budget;
+    std::shared_ptr<Shared> shared;
+    std::shared_ptr<Video>  video;
+    size_t                  videoFrames = 0;
+
+    // copies a finished readback out of its buffer and queues the encoding. with wait it blocks until the
+    // GPU is done, counted in stats.waits with countWait.
+    void retire(Slot& slot, bool wait, bool countWait = true)
+    {
+        if (wait && glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            if (countWait)
+                stats.waits++;
+            while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        size_t bytes = static_cast<size_t>(slot.width) * slot.height * 4;
+        reserve(bytes);
+        std::shared_ptr<std::vector<unsigned char> > pixels(new std::vector<unsigned char>(bytes));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        bool ok = mapped != NULL;
+        if (ok)
+        {
+            memcpy(pixels->data(), mapped, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::shared_ptr<Shared> state = shared;
+        std::shared_ptr<Video> stream = slot.format == CAPTURE_Y4M ? video : std::shared_ptr<Video>();
+        int width = slot.width, height = slot.height;
+        std::string path = slot.path;
+        size_t sequence = slot.sequence;
+        ThreadPool::shared().enqueue([state, stream, pixels, width, height, path, sequence, bytes, ok]() {
+            // the frames this job got into a file or gave up on, a video frame may be written by a later job
+            size_t written = 0, failed = 0;
+            if (stream)
+            {
+                // a failed readback still takes its place in the order, as an empty frame
+                std::vector<unsigned char> frame;
+                if (ok)
+                    frame = toYuv(*pixels, width, height);
+                appendFrame(*stream, sequence, frame, written, failed);
+            }
+            else if (ok && writePng(*pixels, width, height, path))
+                written = 1;
+            else
+                failed = 1;
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->bytes -= bytes;
+            state->encoding--;
+            state->written += written;
+            state->failed += failed;
+            state->changed.notify_all();
+        });
+    }
+
+    // counts bytes against the budget, first waiting for the encoders if they don't fit. a frame larger
+    // than the budget still goes through, alone.
+    void reserve(size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        if (shared->bytes > 0 && shared->bytes + bytes > budget)
+        {
+            stats.stalls++;
+            shared->changed.wait(lock, [this, bytes]() { return shared->bytes == 0 || shared->bytes + bytes <= budget; });
+        }
+        shared->bytes += bytes;
+        shared->encoding++;
+    }
+
+    static bool writePng(std::vector<unsigned char>& pixels, int width, int height, const std::string& path)
+    {
+        // GL's rows go bottom to top
+        size_t stride = static_cast<size_t>(width) * 4;
+        std::vector<unsigned char> row(stride);
+        for (int y = 0; y < height / 2; y++)
+        {
+            unsigned char* top = &pixels[y * stride];
+            unsigned char* bottom = &pixels[(height - 1 - y) * stride];
+            memcpy(row.data(), top, stride);
+            memcpy(top, bottom, stride);
+            memcpy(bottom, row.data(), stride);
+        }
+        if (stbi_write_png(path.c_str(), width, height, 4, pixels.data(), static_cast<int>(stride)))
+            return true;
+        std::cout << "ERROR::FRAME_CAPTURE:: can't write " << path << std::endl;
+        return false;
+    }
+
+    // full range BT.601 4:2:0, the y4m C420jpeg layout: the luma plane, then the chroma planes at half size.
+    // every chroma sample averages its 2x2 pixels. flips to top to bottom on the way.
+    static std::vector<unsigned char> toYuv(const std::vector<unsigned char>& rgba, int width, int height)
+    {
+        size_t luma = static_cast<size_t>(width) * height;
+        std::vector<unsigned char> yuv(luma + luma / 2);
+        unsigned char* u = &yuv[luma];
+        unsigned char* v = u + luma / 4;
+        for (int y = 0; y < height; y += 2)
+            for (int x = 0; x < width; x += 2)
+            {
+                float cb = 0.0f, cr = 0.0f;
+                for (int i = 0; i < 4; i++)
+                {
+                    int px = x + (i & 1), py = y + (i >> 1);
+                    const unsigned char* p = &rgba[(static_cast<size_t>(height - 1 - py) * width + px) * 4];
+                    float r = p[0], g = p[1], b = p[2];
+                    yuv[static_cast<size_t>(py) * width + px] = clampByte(0.299f * r + 0.587f * g + 0.114f * b);
+                    cb += -0.168736f * r - 0.331264f * g + 0.5f * b;
+                    cr += 0.5f * r - 0.418688f * g - 0.081312f * b;
+                }
+                size_t c = static_cast<size_t>(y / 2) * (width / 2) + x / 2;
+                u[c] = clampByte(128.0f + cb / 4.0f);
+                v[c] = clampByte(128.0f + cr / 4.0f);
+            }
+        return yuv;
+    }
+
+    static unsigned char clampByte(float value)
+    {
+        return static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, value + 0.5f)));
+    }
+
+    // writes the frame once every earlier one is written, and the later ones that were waiting for it.
+    // adds the frames that went into the file to written and the ones that didn't to failed, an empty
+    // frame (its readback failed) is skipped and counts as failed. a parked frame counts for neither yet.
+    static void appendFrame(Video& video, size_t sequence, std::vector<unsigned char>& frame, size_t& written, size_t& failed)
+    {
+        std::lock_guard<std::mutex> lock(video.mutex);
+        video.ready[sequence].swap(frame);
+        std::map<size_t, std::vector<unsigned char> >::iterator it;
+        while ((it = video.ready.find(video.written)) != video.ready.end())
+        {
+            const std::vector<unsigned char>& data = it->second;
+            if (!data.empty() && fputs("FRAME\n", video.file) >= 0 && fwrite(data.data(), 1, data.size(), video.file) == data.size())
+                written++;
+            else
+                failed++;
+            video.ready.erase(it);
+            video.written++;
+        }
+    }
+};
+#endif
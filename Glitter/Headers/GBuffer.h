@@ -0,0 +1,32 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+// the render targets of the geometry pass, colors in the order of gbuffer.fs's outputs. the scene is
+// rasterized into them once per frame, everything after that (outlines, shading) reads them in
+// screen space. see the passes in SceneRenderer.h.
+enum GBuffer_Target {
+    GBUFFER_FACE_NORMAL, // flat normals for the normal edges, octahedral in rg, 0 where nothing was drawn
+    GBUFFER_ALBEDO,      // rgb base color, a = 1 where the diffuse map is used
+    GBUFFER_NORMAL,      // smooth normals for shading, octahedral in rg, 0 where nothing was drawn
+    GBUFFER_DEPTH,       // the depth buffer itself, sampled for the depth edges instead of a copy in color
+    GBUFFER_TARGETS
+};
+
+// sized formats of the targets. 16 bits per normal component, 24 of depth for edges that don't band.
+const GLenum GBUFFER_FORMATS[GBUFFER_TARGETS] = { GL_RG16, GL_RGBA8, GL_RG16, GL_DEPTH_COMPONENT24 };
+
+// the targets are point sampled. a filtered tap between a drawn texel and the background is neither 0
+// nor a normal, and averaged octahedral coordinates don't decode to the average normal.
+const GLenum GBUFFER_FILTER = GL_NEAREST;
+
+// clears the bound G-buffer: the normals and albedo to zero so the passes after it can tell the
+// background apart, depth to the far plane
+inline void clearGBuffer()
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearDepth(1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+#endif
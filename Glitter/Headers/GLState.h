@@ -0,0 +1,156 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// texture units the tracker remembers, binds on higher units always go through
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+// the GL state the draw code touches, with every call that wouldn't change anything filtered out.
+// only calls made through here are known to it: code that binds behind its back (the uploads in
+// mesh setup, ModelBatch::build, the texture streamer) has to run before beginFrame(), or be
+// followed by invalidate(). GL thread only.
+class GLState
+{
+public:
+    // GL calls made and calls filtered out
+    struct Counters {
+        size_t issued = 0;
+        size_t skipped = 0;
+    };
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (!changes(this->program, program))
+            return;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (!changes(this->vao, vao))
+            return;
+        glBindVertexArray(vao);
+    }
+
+    void bindFramebuffer(GLuint framebuffer)
+    {
+        if (!changes(this->framebuffer, framebuffer))
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    // a 2D texture on a unit, switching the active unit only when it has to bind
+    void bindTexture(unsigned int unit, GLuint texture)
+    {
+        if (unit < GL_STATE_TEXTURE_UNITS && !changes(textures[unit], texture))
+            return;
+        if (changes(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (unit >= GL_STATE_TEXTURE_UNITS)
+            frame.issued++;
+    }
+
+    void setDepthTest(bool enabled)
+    {
+        setCapability(GL_DEPTH_TEST, depthTest, enabled);
+    }
+
+    void setBlend(bool enabled)
+    {
+        setCapability(GL_BLEND, blend, enabled);
+    }
+
+    void setCull(bool enabled)
+    {
+        setCapability(GL_CULL_FACE, cull, enabled);
+    }
+
+    // forgets everything, the next call of each kind goes through
+    void invalidate()
+    {
+        program = vao = framebuffer = activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            textures[unit] = UNKNOWN;
+        depthTest = blend = cull = UNKNOWN;
+    }
+
+    // starts counting a new frame. forgets the state too, whatever ran between frames may have changed it.
+    void beginFrame()
+    {
+        if (frames)
+        {
+            previous = frame;
+            total.issued += frame.issued;
+            total.skipped += frame.skipped;
+        }
+        frame = Counters();
+        frames++;
+        invalidate();
+    }
+
+    // the counters of the last complete frame
+    const Counters& lastFrame() const
+    {
+        return previous;
+    }
+
+    void report() const
+    {
+        size_t complete = frames > 1 ? frames - 1 : 1;
+        std::cout << "gl state: " << total.issued / complete << " calls issued, " << total.skipped / complete
+                  << " skipped per frame over " << frames - 1 << " frames" << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+
+    GLuint program = UNKNOWN;
+    GLuint vao = UNKNOWN;
+    GLuint framebuffer = UNKNOWN;
+    GLuint activeUnit = UNKNOWN;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLuint depthTest = UNKNOWN, blend = UNKNOWN, cull = UNKNOWN; // 0, 1 or UNKNOWN
+    Counters frame, previous, total;
+    size_t frames = 0;
+
+    GLState()
+    {
+        invalidate();
+    }
+    GLState(const GLState&);
+    GLState& operator=(const GLState&);
+
+    // records value as current, true when that is a change and the call has to be made
+    bool changes(GLuint& current, GLuint value)
+    {
+        if (current == value)
+        {
+            frame.skipped++;
+            return false;
+        }
+        current = value;
+        frame.issued++;
+        return true;
+    }
+
+    void setCapability(GLenum capability, GLuint& current, bool enabled)
+    {
+        if (!changes(current, enabled ? 1 : 0))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+#endif
@@ -0,0 +1,125 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR ((EGLConfig)0)
+#endif
+
+// a core context without a window or a display server, for the batch renderer. EGL on Mesa's surfaceless
+// platform (llvmpipe on nodes without a GPU, or the GPU's render node), the default EGL display where
+// that platform is missing. there is no default framebuffer, everything is drawn into textures.
+// needs libEGL, see GLITTER_HEADLESS in CMakeLists.txt.
+class HeadlessContext
+{
+public:
+    HeadlessContext() {}
+
+    ~HeadlessContext()
+    {
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY)
+            eglTerminate(display);
+    }
+
+    // creates a major.minor core context, makes it current and loads the GL functions
+    bool create(int major = 4, int minor = 0)
+    {
+        display = platformDisplay();
+        EGLint eglMajor, eglMinor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+        {
+            cout << "ERROR::HEADLESS_CONTEXT:: no EGL display" << endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!hasExtension(extensions, "EGL_KHR_surfaceless_context") || !hasExtension(extensions, "EGL_KHR_create_context"))
+        {
+            cout << "ERROR::HEADLESS_CONTEXT:: EGL " << eglMajor << "." << eglMinor << " can't make surfaceless core contexts" << endl;
+            return false;
+        }
+
+        // surfaceless displays may have no configs at all, then a context without one has to do
+        static const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        EGLint count = 0;
+        if ((!eglChooseConfig(display, configAttributes, &config, 1, &count) || count == 0) &&
+            !hasExtension(extensions, "EGL_KHR_no_config_context"))
+        {
+            cout << "ERROR::HEADLESS_CONTEXT:: no EGL config for desktop OpenGL" << endl;
+            return false;
+        }
+        if (count == 0)
+            config = EGL_NO_CONFIG_KHR;
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, major,
+            EGL_CONTEXT_MINOR_VERSION_KHR, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            cout << "ERROR::HEADLESS_CONTEXT:: no OpenGL " << major << "." << minor << " core context (0x" << hex
+                 << eglGetError() << dec << ")" << endl;
+            return false;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            cout << "ERROR::HEADLESS_CONTEXT:: failed to load the OpenGL functions" << endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    HeadlessContext(const HeadlessContext&);
+    HeadlessContext& operator=(const HeadlessContext&);
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static EGLDisplay platformDisplay()
+    {
+        // client extensions, NULL before EGL 1.5 or EXT_client_extensions
+        const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(extensions, "EGL_MESA_platform_surfaceless"))
+        {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay)
+                return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    // whole words of a space separated extension string only, EGL_KHR_context is no EGL_KHR_context_xyz
+    static bool hasExtension(const char* extensions, const char* name)
+    {
+        if (!extensions)
+            return false;
+        size_t length = strlen(name);
+        for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name))
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+                return true;
+        return false;
+    }
+};
+#endif
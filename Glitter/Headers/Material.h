@@ -0,0 +1,236 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "mesh.h"
+#include "shader.h"
+#include "TextureCache.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// every texture type has a unit of its own, the samplers are pointed at them once per program
+enum Texture_Unit {
+    TEXTURE_UNIT_DIFFUSE,
+    TEXTURE_UNIT_SPECULAR,
+    TEXTURE_UNIT_NORMAL,
+    TEXTURE_UNIT_HEIGHT,
+    TEXTURE_UNIT_COUNT
+};
+
+// records in the Materials block, 16 bytes each, so the block stays within the 16KB GL guarantees
+const unsigned int MATERIAL_TABLE_SIZE = 1024;
+const GLuint MATERIAL_BLOCK_BINDING = 2;
+
+// the index of no material: a draw that doesn't apply one (e.g. the outline buffers), or a mesh whose
+// material didn't fit the table, which the material passes skip
+const unsigned int MATERIAL_NONE = ~0u;
+
+// what a draw needs to know about its surface, resolved at load time
+struct Material {
+    unsigned int textures[TEXTURE_UNIT_COUNT]; // GL texture per unit, 0 when the material has none
+    glm::vec3    diffuse;
+    bool         diffuseMap;
+    std::vector<std::shared_ptr<TextureHandle> > handles; // keeps the textures alive
+};
+
+// std140 record of a material in the Materials block: rgb diffuse, a = 1 when the diffuse map replaces it
+struct MaterialRecord {
+    glm::vec4 diffuse;
+};
+
+// every material of the scene, deduplicated. meshes refer to them by index, the records live in a
+// uniform buffer all programs share, and apply() only touches GL for what differs from the last draw
+// (textures are filtered by GLState). materials are counted: every add() is paired with a release() by
+// the owner of the mesh (see ~Model), and the last release lets go of the textures and frees the slot
+// for the next new material. GL thread only.
+class MaterialTable
+{
+public:
+    static MaterialTable& instance()
+    {
+        static MaterialTable table;
+        return table;
+    }
+
+    // the index of the material with these textures and colors, added if it's new. MATERIAL_NONE when
+    // the table is full.
+    unsigned int add(const std::vector<Texture>& textures, const glm::vec3& diffuse, bool diffuseMap)
+    {
+        Material material = Material();
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            int unit = unitOf(textures[i].type);
+            // the shaders sample the first texture of each type only
+            if (unit < 0 || material.textures[unit])
+                continue;
+            material.textures[unit] = textures[i].id;
+            material.handles.push_back(textures[i].handle);
+        }
+        material.diffuse = diffuse;
+        material.diffuseMap = diffuseMap;
+
+        std::string key = keyOf(material);
+        std::unordered_map<std::string, unsigned int>::iterator it = indices.find(key);
+        if (it != indices.end())
+        {
+            references[it->second]++;
+            return it->second;
+        }
+
+        unsigned int index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+            materials[index] = material;
+        }
+        else if (materials.size() < MATERIAL_TABLE_SIZE)
+        {
+            index = static_cast<unsigned int>(materials.size());
+            materials.push_back(material);
+            references.push_back(0);
+        }
+        else
+        {
+            std::cout << "ERROR::MATERIAL_TABLE:: all " << MATERIAL_TABLE_SIZE << " materials are in use, the mesh won't be drawn" << std::endl;
+            return MATERIAL_NONE;
+        }
+        references[index] = 1;
+        indices[key] = index;
+        dirty = true;
+        return index;
+    }
+
+    // drops a reference add() returned, the material goes with the last one. MATERIAL_NONE is ignored.
+    void release(unsigned int index)
+    {
+        if (index >= materials.size() || references[index] == 0 || --references[index] > 0)
+            return;
+        indices.erase(keyOf(materials[index]));
+        materials[index] = Material();
+        freeSlots.push_back(index);
+        if (current == index)
+            current = ~0u;
+    }
+
+    const Material& operator[](unsigned int index) const
+    {
+        return materials[index];
+    }
+
+    // materials in use
+    size_t size() const
+    {
+        return materials.size() - freeSlots.size();
+    }
+
+    // points a program's samplers at the fixed units and its Materials block at the table. once per program.
+    void attach(const Shader& shader) const
+    {
+        static const char* samplers[TEXTURE_UNIT_COUNT] = { "texture_diffuse1", "texture_specular1", "texture_normal1", "texture_height1" };
+        shader.use();
+        for (int unit = 0; unit < TEXTURE_UNIT_COUNT; unit++)
+            shader.setInt(samplers[unit], unit);
+        GLuint block = glGetUniformBlockIndex(shader.ID, "Materials");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, block, MATERIAL_BLOCK_BINDING);
+    }
+
+    // forgets what the last draws applied. call at the start of every pass, other code may have
+    // changed the program or the materialIndex uniform in between.
+    void begin()
+    {
+        if (dirty)
+            upload();
+        program = 0;
+        current = ~0u;
+    }
+
+    // makes the material current for the following draws with shader, skipping whatever is already set.
+    // index must be one add() returned, not MATERIAL_NONE.
+    void apply(const Shader& shader, unsigned int index)
+    {
+        if (program == shader.ID && current == index)
+            return;
+        const Material& material = materials[index];
+        GLState& state = GLState::instance();
+        for (int unit = 0; unit < TEXTURE_UNIT_COUNT; unit++)
+        {
+            // a material without a texture of some type leaves the previous one bound, nothing samples it
+            if (material.textures[unit])
+                state.bindTexture(unit, material.textures[unit]);
+        }
+
+        if (program != shader.ID)
+        {
+            program = shader.ID;
+            materialIndex = shader.uniform<int>("materialIndex");
+        }
+        shader.set(materialIndex, static_cast<int>(index));
+        current = index;
+    }
+
+private:
+    std::vector<Material> materials;
+    std::vector<unsigned int> references; // per material, 0 for a free slot
+    std::vector<unsigned int> freeSlots;
+    std::unordered_map<std::string, unsigned int> indices; // material contents -> index
+    GLuint       buffer = 0;
+    bool         dirty = false;
+    unsigned int program = 0;
+    unsigned int current = ~0u;
+    Uniform<int> materialIndex;
+
+    MaterialTable() {}
+    MaterialTable(const MaterialTable&);
+    MaterialTable& operator=(const MaterialTable&);
+
+    static int unitOf(const std::string& type)
+    {
+        if (type == "texture_diffuse")
+            return TEXTURE_UNIT_DIFFUSE;
+        if (type == "texture_specular")
+            return TEXTURE_UNIT_SPECULAR;
+        if (type == "texture_normal")
+            return TEXTURE_UNIT_NORMAL;
+        if (type == "texture_height")
+            return TEXTURE_UNIT_HEIGHT;
+        return -1;
+    }
+
+    static std::string keyOf(const Material& material)
+    {
+        std::string key(reinterpret_cast<const char*>(material.textures), sizeof(material.textures));
+        key.append(reinterpret_cast<const char*>(&material.diffuse), sizeof(material.diffuse));
+        key.push_back(material.diffuseMap ? 1 : 0);
+        return key;
+    }
+
+    // the packed records of the whole table into the shared block
+    void upload()
+    {
+        std::vector<MaterialRecord> records(materials.size());
+        for (size_t i = 0; i < records.size(); i++)
+            records[i].diffuse = glm::vec4(materials[i].diffuse, materials[i].diffuseMap ? 1.0f : 0.0f);
+        if (!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, MATERIAL_TABLE_SIZE * sizeof(MaterialRecord), NULL, GL_STATIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, buffer);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (!records.empty())
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, records.size() * sizeof(MaterialRecord), records.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirty = false;
+    }
+};
+#endif
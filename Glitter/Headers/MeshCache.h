@@ -0,0 +1,435 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// on-disk bake of a fully processed model, stored next to the source as "<source>.meshcache".
+//
+// layout (native endianness, every block 4-byte aligned):
+//   MeshCacheHeader
+//   per dependency: MeshCacheDependency, name chars, zero padding to 4 bytes
+//   per mesh: MeshCacheRecord, texture refs, MeshLod[lodCount], Meshlet[meshletCount], Vertex[vertexCount],
+//             unsigned int[indexCount]
+//   texture ref: uint32 typeLength, uint32 pathLength, type chars, path chars, zero padding to 4 bytes
+//
+// a cache is only used when the version, import flags and sizeof(Vertex) match and every file it was
+// baked from is unchanged: the source (the empty name) and the .mtl libraries an .obj names, relative to
+// its directory. a file counts as unchanged when its size and mtime match, or when only the mtime moved
+// and its contents still hash the same, so a hit costs a stat per file rather than reading the model.
+// editing the model, its materials, the importer flags or the Vertex struct quietly re-bakes it. bump the
+// version whenever the processing after import changes.
+//   2: meshes are reordered by MeshOptimizer
+//   3: levels of detail from MeshSimplifier
+//   4: meshlets from MeshletBuilder
+//   5: keyed on the source's size and mtime and on its material libraries
+
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// the size of a dependency that didn't exist at bake time, it must still be missing
+const uint64_t MESH_CACHE_MISSING = ~0ULL;
+// the mtime of a dependency modified in the second it was baked, it never matches
+const int64_t MESH_CACHE_RACY = INT64_MIN;
+
+struct MeshCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t dependencyCount;
+};
+
+struct MeshCacheDependency {
+    uint64_t size;
+    int64_t  mtime;
+    uint64_t hash;       // of the contents, only read when the mtime differs
+    uint32_t nameLength;
+    uint32_t reserved;
+};
+
+struct MeshCacheRecord {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t diffuseMap;
+    float    diffuse[3];
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    uint32_t reserved;
+};
+
+// a mesh as it sits in the mapped cache file. the vertex/index pointers point straight into the mapping.
+struct CachedMesh {
+    const Vertex*       vertices;
+    uint32_t            vertexCount;
+    const unsigned int* indices;
+    uint32_t            indexCount;
+    glm::vec3           diffuse;
+    bool                diffuseMap;
+    vector<TextureRef>  textures;
+    vector<MeshLod>     lods;
+    vector<Meshlet>     meshlets;
+};
+
+class MeshCache
+{
+public:
+    // meshes found by the last successful open(), valid as long as this object lives
+    vector<CachedMesh> meshes;
+
+    // maps the cache of the source file if it's still fresh. returns false on a miss (no cache, stale cache
+    // or bad file), in which case store() can be used once the model has been imported the slow way.
+    bool open(const string& sourcePath, uint32_t importFlags)
+    {
+        meshes.clear();
+        cache.close();
+        source = sourcePath;
+        flags = importFlags;
+        opened = true;
+
+        if (!cache.open(cachePath(sourcePath)))
+            return false;
+        if (!parse())
+        {
+            meshes.clear();
+            cache.close();
+            return false;
+        }
+        return true;
+    }
+
+    // writes the processed meshes (Mesh or MeshData) of the source passed to open(). written to a temp
+    // file first, so a crash mid-write never leaves a half baked cache behind.
+    template <typename ProcessedMesh>
+    bool store(const vector<ProcessedMesh>& processed)
+    {
+        if (!opened)
+            return false;
+        vector<MeshCacheDependency> dependencies;
+        vector<string> names;
+        if (!stampDependencies(dependencies, names))
+            return false;
+
+        string path = cachePath(source);
+        string tmpPath = path + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out)
+            return false;
+
+        MeshCacheHeader header;
+        memcpy(header.magic, "GMC", 4);
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = flags;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = static_cast<uint32_t>(processed.size());
+        header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        for (size_t i = 0; ok && i < dependencies.size(); i++)
+            ok = fwrite(&dependencies[i], sizeof(MeshCacheDependency), 1, out) == 1 && writePadded(out, names[i]);
+
+        for (size_t i = 0; ok && i < processed.size(); i++)
+        {
+            const ProcessedMesh& mesh = processed[i];
+            MeshCacheRecord record;
+            record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+            record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+            record.diffuseMap = mesh.diffuse_map ? 1 : 0;
+            record.diffuse[0] = mesh.diffuse.x;
+            record.diffuse[1] = mesh.diffuse.y;
+            record.diffuse[2] = mesh.diffuse.z;
+            record.lodCount = static_cast<uint32_t>(mesh.lods.size());
+            record.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+            record.reserved = 0;
+            ok = fwrite(&record, sizeof(record), 1, out) == 1;
+
+            for (size_t t = 0; ok && t < mesh.textures.size(); t++)
+                ok = writeTextureRef(out, mesh.textures[t].type, mesh.textures[t].path);
+            if (ok && record.lodCount)
+                ok = fwrite(&mesh.lods[0], sizeof(MeshLod), record.lodCount, out) == record.lodCount;
+            if (ok && record.meshletCount)
+                ok = fwrite(&mesh.meshlets[0], sizeof(Meshlet), record.meshletCount, out) == record.meshletCount;
+
+            if (ok && record.vertexCount)
+                ok = fwrite(&mesh.vertices[0], sizeof(Vertex), record.vertexCount, out) == record.vertexCount;
+            if (ok && record.indexCount)
+                ok = fwrite(&mesh.indices[0], sizeof(unsigned int), record.indexCount, out) == record.indexCount;
+        }
+
+        ok = (fclose(out) == 0) && ok;
+        if (!ok)
+        {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        // rename() won't replace an existing file on windows
+        remove(path.c_str());
+        return rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    static string cachePath(const string& sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // 64-bit FNV-1a
+    static uint64_t hashBytes(const unsigned char* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // the material libraries an .obj names in its mtllib lines, as written
+    static vector<string> materialLibraries(const unsigned char* data, size_t size)
+    {
+        vector<string> libraries;
+        const char* p = reinterpret_cast<const char*>(data);
+        const char* end = p + size;
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            while (p < lineEnd && (*p == ' ' || *p == '\t'))
+                p++;
+            if (lineEnd - p > 7 && memcmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t'))
+            {
+                const char* name = p + 7;
+                const char* e = lineEnd;
+                while (name < e && (*name == ' ' || *name == '\t'))
+                    name++;
+                while (e > name && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r'))
+                    e--;
+                if (e > name)
+                    libraries.push_back(string(name, e));
+            }
+            p = lineEnd + 1;
+        }
+        return libraries;
+    }
+
+private:
+    MappedFile cache;
+    string   source;
+    uint32_t flags = 0;
+    bool     opened = false;
+
+    static size_t align4(size_t n)
+    {
+        return (n + 3) & ~static_cast<size_t>(3);
+    }
+
+    // where a dependency is: the source itself for the empty name, otherwise next to it
+    string dependencyPath(const string& name) const
+    {
+        if (name.empty())
+            return source;
+        size_t slash = source.find_last_of("/\\");
+        return slash == string::npos ? name : source.substr(0, slash + 1) + name;
+    }
+
+    // size, mtime and hash of a file, MESH_CACHE_MISSING for a file that doesn't exist
+    static void stamp(const string& path, MeshCacheDependency& dependency)
+    {
+        struct stat st;
+        dependency.reserved = 0;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            dependency.size = MESH_CACHE_MISSING;
+            dependency.mtime = 0;
+            dependency.hash = 0;
+            return;
+        }
+        MappedFile file(path);
+        dependency.size = static_cast<uint64_t>(st.st_size);
+        dependency.mtime = static_cast<int64_t>(st.st_mtime);
+        dependency.hash = hashBytes(file.data(), file.size());
+        // an edit later in the same second would keep the mtime, such files are always compared by contents
+        if (st.st_mtime >= time(NULL))
+            dependency.mtime = MESH_CACHE_RACY;
+    }
+
+    // the source and, for an .obj, its material libraries, as they are now
+    bool stampDependencies(vector<MeshCacheDependency>& dependencies, vector<string>& names) const
+    {
+        MeshCacheDependency dependency;
+        stamp(source, dependency);
+        if (dependency.size == MESH_CACHE_MISSING)
+            return false;
+        dependency.nameLength = 0;
+        names.push_back(string());
+        dependencies.push_back(dependency);
+
+        string extension = source.substr(source.find_last_of('.') + 1);
+        transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        if (extension != "obj")
+            return true;
+        MappedFile src(source);
+        vector<string> libraries = materialLibraries(src.data(), src.size());
+        for (size_t i = 0; i < libraries.size(); i++)
+        {
+            stamp(dependencyPath(libraries[i]), dependency);
+            dependency.nameLength = static_cast<uint32_t>(libraries[i].size());
+            names.push_back(libraries[i]);
+            dependencies.push_back(dependency);
+        }
+        return true;
+    }
+
+    // true while the file still is what it was at bake time
+    bool unchanged(const MeshCacheDependency& dependency, const string& name) const
+    {
+        string path = dependencyPath(name);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return dependency.size == MESH_CACHE_MISSING;
+        if (dependency.size != static_cast<uint64_t>(st.st_size))
+            return false;
+        if (dependency.mtime == static_cast<int64_t>(st.st_mtime))
+            return true;
+        // touched, e.g. by a checkout, the contents decide
+        MappedFile file(path);
+        return hashBytes(file.data(), file.size()) == dependency.hash;
+    }
+
+    static bool writePadded(FILE* out, const string& chars)
+    {
+        static const char padding[4] = { 0, 0, 0, 0 };
+        size_t pad = align4(chars.size()) - chars.size();
+        return fwrite(chars.data(), 1, chars.size(), out) == chars.size() && fwrite(padding, 1, pad, out) == pad;
+    }
+
+    static bool writeTextureRef(FILE* out, const string& type, const string& path)
+    {
+        uint32_t lengths[2] = { static_cast<uint32_t>(type.size()), static_cast<uint32_t>(path.size()) };
+        static const char padding[4] = { 0, 0, 0, 0 };
+        size_t pad = align4(type.size() + path.size()) - (type.size() + path.size());
+        return fwrite(lengths, sizeof(lengths), 1, out) == 1
+            && fwrite(type.data(), 1, type.size(), out) == type.size()
+            && fwrite(path.data(), 1, path.size(), out) == path.size()
+            && fwrite(padding, 1, pad, out) == pad;
+    }
+
+    // validates the mapped cache and fills meshes. every read is bounds checked, a truncated
+    // or foreign file is treated as a miss.
+    bool parse()
+    {
+        const unsigned char* base = cache.data();
+        size_t size = cache.size();
+        size_t offset = 0;
+
+        if (size < sizeof(MeshCacheHeader))
+            return false;
+        MeshCacheHeader header;
+        memcpy(&header, base, sizeof(header));
+        offset += sizeof(header);
+        if (memcmp(header.magic, "GMC", 4) != 0 || header.version != MESH_CACHE_VERSION
+            || header.importFlags != flags || header.vertexSize != sizeof(Vertex) || header.dependencyCount == 0)
+            return false;
+
+        for (uint32_t i = 0; i < header.dependencyCount; i++)
+        {
+            MeshCacheDependency dependency;
+            if (size - offset < sizeof(dependency))
+                return false;
+            memcpy(&dependency, base + offset, sizeof(dependency));
+            offset += sizeof(dependency);
+            if (size - offset < align4(dependency.nameLength))
+                return false;
+            string name(reinterpret_cast<const char*>(base + offset), dependency.nameLength);
+            offset += align4(dependency.nameLength);
+            if (!unchanged(dependency, name))
+                return false;
+        }
+
+        meshes.reserve(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            if (size - offset < sizeof(MeshCacheRecord))
+                return false;
+            MeshCacheRecord record;
+            memcpy(&record, base + offset, sizeof(record));
+            offset += sizeof(record);
+
+            CachedMesh mesh;
+            mesh.vertexCount = record.vertexCount;
+            mesh.indexCount = record.indexCount;
+            mesh.diffuse = glm::vec3(record.diffuse[0], record.diffuse[1], record.diffuse[2]);
+            mesh.diffuseMap = record.diffuseMap != 0;
+
+            for (uint32_t t = 0; t < record.textureCount; t++)
+            {
+                uint32_t lengths[2];
+                if (size - offset < sizeof(lengths))
+                    return false;
+                memcpy(lengths, base + offset, sizeof(lengths));
+                offset += sizeof(lengths);
+                size_t chars = static_cast<size_t>(lengths[0]) + lengths[1];
+                if (size - offset < align4(chars))
+                    return false;
+                TextureRef ref;
+                ref.type.assign(reinterpret_cast<const char*>(base + offset), lengths[0]);
+                ref.path.assign(reinterpret_cast<const char*>(base + offset) + lengths[0], lengths[1]);
+                mesh.textures.push_back(ref);
+                offset += align4(chars);
+            }
+
+            size_t lodBytes = static_cast<size_t>(record.lodCount) * sizeof(MeshLod);
+            if (size - offset < lodBytes)
+                return false;
+            mesh.lods.resize(record.lodCount);
+            if (record.lodCount)
+                memcpy(&mesh.lods[0], base + offset, lodBytes);
+            offset += lodBytes;
+            for (uint32_t l = 0; l < record.lodCount; l++)
+                if (mesh.lods[l].firstIndex > record.indexCount || mesh.lods[l].indexCount > record.indexCount - mesh.lods[l].firstIndex
+                    || mesh.lods[l].firstMeshlet > record.meshletCount || mesh.lods[l].meshletCount > record.meshletCount - mesh.lods[l].firstMeshlet)
+                    return false;
+
+            size_t meshletBytes = static_cast<size_t>(record.meshletCount) * sizeof(Meshlet);
+            if (size - offset < meshletBytes)
+                return false;
+            mesh.meshlets.resize(record.meshletCount);
+            if (record.meshletCount)
+                memcpy(&mesh.meshlets[0], base + offset, meshletBytes);
+            offset += meshletBytes;
+            for (uint32_t m = 0; m < record.meshletCount; m++)
+                if (mesh.meshlets[m].firstIndex > record.indexCount || mesh.meshlets[m].indexCount > record.indexCount - mesh.meshlets[m].firstIndex)
+                    return false;
+
+            size_t vertexBytes = static_cast<size_t>(record.vertexCount) * sizeof(Vertex);
+            size_t indexBytes = static_cast<size_t>(record.indexCount) * sizeof(unsigned int);
+            if (size - offset < vertexBytes + indexBytes)
+                return false;
+            mesh.vertices = reinterpret_cast<const Vertex*>(base + offset);
+            offset += vertexBytes;
+            mesh.indices = reinterpret_cast<const unsigned int*>(base + offset);
+            offset += indexBytes;
+
+            // a corrupt index would send glDrawElements past the end of the vertex buffer
+            for (uint32_t n = 0; n < record.indexCount; n++)
+                if (mesh.indices[n] >= record.vertexCount)
+                    return false;
+
+            meshes.push_back(mesh);
+        }
+        return offset == size;
+    }
+};
+#endif
@@ -0,0 +1,311 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+// FIFO size the statistics and the reordering assume. real post-transform caches vary by GPU,
+// an ordering tuned for 16 entries holds up well on all of them.
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// post-transform cache efficiency of an index buffer, see MeshOptimizer::analyze
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t vertices = 0;     // vertices referenced by the index buffer
+    size_t transforms = 0;   // vertex shader invocations with a FIFO cache of VERTEX_CACHE_SIZE
+    float acmr() const { return triangles ? static_cast<float>(transforms) / triangles : 0.0f; } // average cache miss ratio, transforms per triangle
+    float atvr() const { return vertices ? static_cast<float>(transforms) / vertices : 0.0f; }   // average transform to vertex ratio, 1.0 is ideal
+
+    void add(const VertexCacheStats& other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transforms += other.transforms;
+    }
+};
+
+// import-time reordering of a mesh for the GPU:
+//   1. triangles in Tipsify order (Sander, Nehab, Barczak 2007) for post-transform cache hits
+//   2. the clusters Tipsify leaves behind sorted outside-in, a view independent overdraw reduction
+//   3. vertices renumbered in first-use order so vertex fetch streams through memory
+// the rendering result is identical, only the order of triangles and vertices changes.
+class MeshOptimizer
+{
+public:
+    // reorders mesh in place. before/after get the cache statistics of the original and the result.
+    static void optimize(MeshData& mesh, VertexCacheStats* before = NULL, VertexCacheStats* after = NULL, float overdrawThreshold = 1.05f)
+    {
+        if (before)
+            *before = analyze(mesh.indices, mesh.vertices.size());
+        if (mesh.indices.size() >= 3 && !mesh.vertices.empty())
+        {
+            vector<unsigned int> clusters;
+            optimizeVertexCache(mesh.indices, mesh.vertices.size(), clusters);
+            optimizeOverdraw(mesh.indices, mesh.vertices, clusters, overdrawThreshold);
+            optimizeVertexFetch(mesh.vertices, mesh.indices);
+        }
+        if (after)
+            *after = analyze(mesh.indices, mesh.vertices.size());
+    }
+
+    // simulates a FIFO post-transform cache over a triangle list
+    static VertexCacheStats analyze(const vector<unsigned int>& indices, size_t vertexCount)
+    {
+        VertexCacheStats stats;
+        stats.triangles = indices.size() / 3;
+        vector<size_t> stamps(vertexCount, 0);
+        vector<bool> used(vertexCount, false);
+        size_t time = VERTEX_CACHE_SIZE + 1;
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int v = indices[i];
+            if (time - stamps[v] > VERTEX_CACHE_SIZE)
+            {
+                stamps[v] = time++;
+                stats.transforms++;
+            }
+            if (!used[v])
+            {
+                used[v] = true;
+                stats.vertices++;
+            }
+        }
+        return stats;
+    }
+
+    // Tipsify: fans around the vertex that is most likely still cached, falling back to the dead-end
+    // stack and finally a linear scan. clusters receives the first triangle of every run that had to
+    // start from a cold cache, those are the hard boundaries the overdraw pass may move around.
+    static void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount, vector<unsigned int>& clusters)
+    {
+        size_t triangleCount = indices.size() / 3;
+        const unsigned int k = VERTEX_CACHE_SIZE;
+
+        // vertex -> triangle adjacency
+        vector<unsigned int> live(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            live[indices[i]]++;
+        vector<unsigned int> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        vector<unsigned int> adjacency(triangleCount * 3);
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int c = 0; c < 3; c++)
+                adjacency[fill[indices[t * 3 + c]]++] = static_cast<unsigned int>(t);
+
+        vector<size_t> stamps(vertexCount, 0);
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> deadEnd;
+        vector<unsigned int> candidates;
+        vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        clusters.clear();
+
+        size_t time = k + 1;
+        size_t cursor = 0;
+        int fanning = vertexCount ? nextLive(live, cursor) : -1;
+        while (fanning >= 0)
+        {
+            if (time - stamps[fanning] > k)
+                clusters.push_back(static_cast<unsigned int>(result.size() / 3));
+
+            candidates.clear();
+            for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+            {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                emitted[t] = true;
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int v = indices[t * 3 + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - stamps[v] > k)
+                        stamps[v] = time++;
+                }
+            }
+
+            // the candidate that stays in cache through its remaining fans and entered it earliest
+            int next = -1;
+            long best = -1;
+            for (size_t c = 0; c < candidates.size(); c++)
+            {
+                unsigned int v = candidates[c];
+                if (!live[v])
+                    continue;
+                long priority = 0;
+                if (time - stamps[v] + 2 * live[v] <= k)
+                    priority = static_cast<long>(time - stamps[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    next = static_cast<int>(v);
+                }
+            }
+            if (next < 0)
+            {
+                while (!deadEnd.empty() && next < 0)
+                {
+                    unsigned int v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[v])
+                        next = static_cast<int>(v);
+                }
+                if (next < 0)
+                    next = nextLive(live, cursor);
+            }
+            fanning = next;
+        }
+        indices.swap(result);
+    }
+
+    // splits Tipsify's clusters further wherever that costs little cache efficiency, then sorts them
+    // so the triangles facing away from the mesh center come first. those are the likely occluders
+    // from any direction, drawing them early lets the depth test reject more of what follows.
+    static void optimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, vector<unsigned int>& clusters, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (clusters.empty() || clusters[0] != 0)
+            clusters.insert(clusters.begin(), 0);
+        clusters = softBoundaries(indices, vertices.size(), clusters, threshold);
+
+        // area weighted centroid of the whole mesh
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        vector<glm::vec3> centers(triangleCount);
+        vector<glm::vec3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+            normals[t] = glm::cross(b - a, c - a); // length is twice the area
+            centers[t] = (a + b + c) / 3.0f;
+            float area = glm::length(normals[t]);
+            meshCenter += centers[t] * area;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+
+        struct Cluster {
+            unsigned int first, last;
+            float sortKey;
+        };
+        vector<Cluster> sorted(clusters.size());
+        for (size_t i = 0; i < clusters.size(); i++)
+        {
+            Cluster& cluster = sorted[i];
+            cluster.first = clusters[i];
+            cluster.last = i + 1 < clusters.size() ? clusters[i + 1] : static_cast<unsigned int>(triangleCount);
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (unsigned int t = cluster.first; t < cluster.last; t++)
+            {
+                float a = glm::length(normals[t]);
+                center += centers[t] * a;
+                normal += normals[t];
+                area += a;
+            }
+            float length = glm::length(normal);
+            cluster.sortKey = area > 0.0f && length > 0.0f ? glm::dot(center / area - meshCenter, normal / length) : 0.0f;
+        }
+        stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t i = 0; i < sorted.size(); i++)
+            result.insert(result.end(), indices.begin() + sorted[i].first * 3, indices.begin() + sorted[i].last * 3);
+        indices.swap(result);
+    }
+
+    // renumbers vertices in the order the index buffer first touches them. vertices no triangle uses are dropped.
+    static void optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+    {
+        const unsigned int unused = ~0u;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> result;
+        result.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int& slot = remap[indices[i]];
+            if (slot == unused)
+            {
+                slot = static_cast<unsigned int>(result.size());
+                result.push_back(vertices[indices[i]]);
+            }
+            indices[i] = slot;
+        }
+        vertices.swap(result);
+    }
+
+private:
+    static int nextLive(const vector<unsigned int>& live, size_t& cursor)
+    {
+        while (cursor < live.size())
+        {
+            if (live[cursor])
+                return static_cast<int>(cursor);
+            cursor++;
+        }
+        return -1;
+    }
+
+    // a cluster is cut after any triangle where the cache misses since the last cut stay within
+    // threshold times the cluster's own miss ratio, so the reordering keeps ACMR within that factor
+    static vector<unsigned int> softBoundaries(const vector<unsigned int>& indices, size_t vertexCount, const vector<unsigned int>& clusters, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        vector<size_t> stamps(vertexCount, 0);
+        size_t time = VERTEX_CACHE_SIZE + 1;
+
+        // misses per triangle in the current order
+        vector<unsigned char> misses(triangleCount, 0);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = indices[t * 3 + c];
+                if (time - stamps[v] > VERTEX_CACHE_SIZE)
+                {
+                    stamps[v] = time++;
+                    misses[t]++;
+                }
+            }
+
+        vector<unsigned int> result;
+        for (size_t i = 0; i < clusters.size(); i++)
+        {
+            size_t first = clusters[i];
+            size_t last = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+            size_t total = 0;
+            for (size_t t = first; t < last; t++)
+                total += misses[t];
+            float limit = threshold * total / static_cast<float>(last - first);
+
+            result.push_back(static_cast<unsigned int>(first));
+            size_t start = first, running = 0;
+            for (size_t t = first; t + 1 < last; t++)
+            {
+                running += misses[t];
+                // a minimum cluster size keeps the sort from shredding cache locality
+                if (t + 1 - start >= 8 && running <= limit * (t + 1 - start))
+                {
+                    result.push_back(static_cast<unsigned int>(t + 1));
+                    start = t + 1;
+                    running = 0;
+                }
+            }
+        }
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,565 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// levels of detail generated per mesh on top of the full resolution one
+const int MESH_LOD_LEVELS = 4;
+// edges whose faces meet at more than 60 degrees are creases
+const float MESH_CREASE_COS = 0.5f;
+// how strongly creases and open borders hold on to their position, relative to a face plane
+const float MESH_CREASE_WEIGHT = 4.0f;
+const float MESH_BORDER_WEIGHT = 16.0f;
+
+// builds a chain of levels of detail for a mesh at import time.
+//
+// quadric error metric (Garland, Heckbert 1997) driven half-edge collapses on the position-welded
+// mesh, so every simplified vertex sits on an original position. vertices are only allowed to
+// slide along the features the outline passes pick up:
+//   - open borders and normal/uv seams only collapse along themselves, junctions never move
+//   - crease edges (sharp dihedral angle) add constraint planes to the quadrics
+//   - collapses that would flip a triangle are rejected
+// each level gets vertices of its own (with face normals of the simplified triangles, which the
+// silhouette normal pass needs), appended to the mesh, and an index range appended to the indices.
+class MeshSimplifier
+{
+public:
+    // fills mesh.lods: lods[0] is the original mesh, each further level has about `ratio` times the
+    // triangles of the one before. stops early once a level would deviate from the original by more
+    // than maxError times the bounding radius or simplification stalls.
+    static void buildLods(MeshData& mesh, float ratio = 0.5f, float maxError = 0.1f)
+    {
+        mesh.lods.clear();
+        MeshLod full = { 0, static_cast<unsigned int>(mesh.indices.size()), 0.0f, 0, 0 };
+        mesh.lods.push_back(full);
+        if (mesh.indices.size() < 3 * 64)
+            return;
+
+        MeshSimplifier simplifier(mesh);
+        float errorLimit = maxError * simplifier.radius;
+        size_t previous = mesh.indices.size() / 3;
+        for (int level = 1; level <= MESH_LOD_LEVELS; level++)
+        {
+            size_t target = static_cast<size_t>(previous * ratio);
+            float error = simplifier.simplify(target, errorLimit * errorLimit);
+            size_t triangles = simplifier.aliveTriangles;
+            // not worth a level of its own
+            if (triangles == 0 || triangles > previous * 0.9f)
+                break;
+            simplifier.appendLod(mesh, error);
+            previous = triangles;
+        }
+    }
+
+private:
+    enum Kind {
+        KIND_MANIFOLD, // interior vertex with a single set of attributes
+        KIND_BORDER,   // on an open border, slides along it
+        KIND_SEAM,     // two sets of attributes, slides along the seam
+        KIND_LOCKED    // corners, seam junctions, non-manifold spots
+    };
+
+    // symmetric 4x4 error quadric
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        static Quadric plane(const glm::vec3& n, float d, float weight)
+        {
+            Quadric q;
+            double a = n.x, b = n.y, c = n.z, e = d;
+            q.a2 = a * a * weight; q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * e * weight;
+            q.b2 = b * b * weight; q.bc = b * c * weight; q.bd = b * e * weight;
+            q.c2 = c * c * weight; q.cd = c * e * weight;
+            q.d2 = e * e * weight;
+            return q;
+        }
+
+        void add(const Quadric& o)
+        {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2;
+            bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+        }
+
+        double evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double r = a2 * x * x + b2 * y * y + c2 * z * z + d2
+                + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+            return r > 0.0 ? r : 0.0;
+        }
+    };
+
+    struct Triangle {
+        unsigned int p[3]; // welded positions
+        unsigned int w[3]; // wedges: a position plus one set of attributes
+        bool alive;
+    };
+
+    struct Candidate {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromStamp, toStamp;
+        bool operator<(const Candidate& o) const { return cost > o.cost; } // min-heap
+    };
+
+    vector<glm::vec3> positions;
+    vector<Quadric>   quadrics;
+    vector<Kind>      kinds;
+    vector<unsigned int> stamps;
+    vector<bool>      removed;
+    vector<vector<unsigned int> > incident; // triangles around each position, may hold stale entries
+    vector<Vertex>    wedges;               // attributes per wedge
+    vector<Triangle>  triangles;
+    priority_queue<Candidate> heap;
+    size_t aliveTriangles = 0;
+    float  radius = 0.0f;
+    double maxCost = 0.0;
+
+    struct Vec3Hash {
+        size_t operator()(const glm::vec3& v) const
+        {
+            unsigned int b[3];
+            memcpy(b, &v, sizeof(b));
+            return b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u;
+        }
+    };
+
+    struct Vec3Equal {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const { return memcmp(&a, &b, sizeof(a)) == 0; }
+    };
+
+    struct WedgeKey {
+        unsigned int position;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        bool operator==(const WedgeKey& o) const
+        {
+            return position == o.position && memcmp(&normal, &o.normal, sizeof(normal)) == 0 && memcmp(&uv, &o.uv, sizeof(uv)) == 0;
+        }
+    };
+
+    struct WedgeHash {
+        size_t operator()(const WedgeKey& k) const
+        {
+            unsigned int b[5];
+            memcpy(b, &k.normal, 12);
+            memcpy(b + 3, &k.uv, 8);
+            return k.position * 2654435761u ^ b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u ^ b[3] * 40503u ^ b[4] * 2246822519u;
+        }
+    };
+
+    static unsigned long long edgeKey(unsigned int a, unsigned int b)
+    {
+        if (a > b)
+            swap(a, b);
+        return (static_cast<unsigned long long>(a) << 32) | b;
+    }
+
+    explicit MeshSimplifier(const MeshData& mesh)
+    {
+        // weld positions and split them into wedges. the face normal is ignored, it is recomputed per level.
+        vector<unsigned int> positionOf(mesh.vertices.size()), wedgeOf(mesh.vertices.size());
+        unordered_map<glm::vec3, unsigned int, Vec3Hash, Vec3Equal> welded;
+        unordered_map<WedgeKey, unsigned int, WedgeHash> wedgeIds;
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            const Vertex& v = mesh.vertices[i];
+            pair<unordered_map<glm::vec3, unsigned int, Vec3Hash, Vec3Equal>::iterator, bool> p =
+                welded.insert(make_pair(v.Position, static_cast<unsigned int>(positions.size())));
+            if (p.second)
+                positions.push_back(v.Position);
+            positionOf[i] = p.first->second;
+
+            WedgeKey key = { positionOf[i], v.Normal, v.TexCoords };
+            pair<unordered_map<WedgeKey, unsigned int, WedgeHash>::iterator, bool> w =
+                wedgeIds.insert(make_pair(key, static_cast<unsigned int>(wedges.size())));
+            if (w.second)
+                wedges.push_back(v);
+            wedgeOf[i] = w.first->second;
+        }
+
+        glm::vec3 lo = positions.empty() ? glm::vec3(0.0f) : positions[0], hi = lo;
+        for (size_t i = 1; i < positions.size(); i++)
+        {
+            lo = glm::min(lo, positions[i]);
+            hi = glm::max(hi, positions[i]);
+        }
+        radius = glm::length(hi - lo) * 0.5f;
+
+        incident.resize(positions.size());
+        quadrics.resize(positions.size());
+        stamps.assign(positions.size(), 0);
+        removed.assign(positions.size(), false);
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            Triangle t;
+            for (int c = 0; c < 3; c++)
+            {
+                t.p[c] = positionOf[mesh.indices[i + c]];
+                t.w[c] = wedgeOf[mesh.indices[i + c]];
+            }
+            t.alive = t.p[0] != t.p[1] && t.p[1] != t.p[2] && t.p[0] != t.p[2];
+            if (!t.alive)
+                continue;
+            for (int c = 0; c < 3; c++)
+                incident[t.p[c]].push_back(static_cast<unsigned int>(triangles.size()));
+            triangles.push_back(t);
+        }
+        aliveTriangles = triangles.size();
+
+        classify();
+        for (unsigned int p = 0; p < positions.size(); p++)
+            pushCandidates(p);
+    }
+
+    glm::vec3 faceNormal(const Triangle& t) const
+    {
+        return glm::cross(positions[t.p[1]] - positions[t.p[0]], positions[t.p[2]] - positions[t.p[0]]);
+    }
+
+    // vertex kinds from the original topology, plus the face, border and crease quadrics
+    void classify()
+    {
+        struct EdgeInfo {
+            unsigned int count = 0;
+            unsigned int triangle[2];
+            unsigned int corner[2];
+        };
+        unordered_map<unsigned long long, EdgeInfo> edges;
+        edges.reserve(triangles.size() * 2);
+        for (unsigned int t = 0; t < triangles.size(); t++)
+        {
+            const Triangle& tri = triangles[t];
+            glm::vec3 n = faceNormal(tri);
+            float area = glm::length(n);
+            if (area > 0.0f)
+            {
+                n /= area;
+                Quadric q = Quadric::plane(n, -glm::dot(n, positions[tri.p[0]]), 1.0f);
+                for (int c = 0; c < 3; c++)
+                    quadrics[tri.p[c]].add(q);
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                EdgeInfo& e = edges[edgeKey(tri.p[c], tri.p[(c + 1) % 3])];
+                if (e.count < 2)
+                {
+                    e.triangle[e.count] = t;
+                    e.corner[e.count] = c;
+                }
+                e.count++;
+            }
+        }
+
+        vector<bool> border(positions.size(), false), locked(positions.size(), false);
+        for (unordered_map<unsigned long long, EdgeInfo>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+        {
+            const EdgeInfo& e = it->second;
+            const Triangle& t0 = triangles[e.triangle[0]];
+            unsigned int a = t0.p[e.corner[0]], b = t0.p[(e.corner[0] + 1) % 3];
+            if (e.count > 2)
+            {
+                locked[a] = locked[b] = true;
+                continue;
+            }
+            glm::vec3 n0 = glm::normalize(faceNormal(t0));
+            if (e.count == 1)
+            {
+                border[a] = border[b] = true;
+                addEdgeConstraint(a, b, n0, MESH_BORDER_WEIGHT);
+                continue;
+            }
+            glm::vec3 n1 = glm::normalize(faceNormal(triangles[e.triangle[1]]));
+            if (glm::dot(n0, n1) < MESH_CREASE_COS)
+            {
+                addEdgeConstraint(a, b, n0, MESH_CREASE_WEIGHT);
+                addEdgeConstraint(a, b, n1, MESH_CREASE_WEIGHT);
+            }
+        }
+
+        // distinct wedges per position
+        vector<vector<unsigned int> > seen(positions.size());
+        for (size_t t = 0; t < triangles.size(); t++)
+            for (int c = 0; c < 3; c++)
+            {
+                vector<unsigned int>& s = seen[triangles[t].p[c]];
+                if (find(s.begin(), s.end(), triangles[t].w[c]) == s.end())
+                    s.push_back(triangles[t].w[c]);
+            }
+
+        kinds.resize(positions.size());
+        for (size_t p = 0; p < positions.size(); p++)
+        {
+            size_t count = seen[p].size();
+            if (locked[p] || count > 2 || (border[p] && count > 1))
+                kinds[p] = KIND_LOCKED;
+            else if (border[p])
+                kinds[p] = KIND_BORDER;
+            else if (count == 2)
+                kinds[p] = KIND_SEAM;
+            else
+                kinds[p] = KIND_MANIFOLD;
+        }
+    }
+
+    // plane through the edge, perpendicular to the face: keeps the vertices on the edge's line
+    void addEdgeConstraint(unsigned int a, unsigned int b, const glm::vec3& faceNormal, float weight)
+    {
+        glm::vec3 edge = positions[b] - positions[a];
+        float length = glm::length(edge);
+        if (length <= 0.0f)
+            return;
+        glm::vec3 n = glm::cross(edge / length, faceNormal);
+        float nl = glm::length(n);
+        if (nl <= 0.0f)
+            return;
+        n /= nl;
+        Quadric q = Quadric::plane(n, -glm::dot(n, positions[a]), weight);
+        quadrics[a].add(q);
+        quadrics[b].add(q);
+    }
+
+    // triangles currently alive around p
+    void around(unsigned int p, vector<unsigned int>& out) const
+    {
+        out.clear();
+        const vector<unsigned int>& list = incident[p];
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            const Triangle& t = triangles[list[i]];
+            if (t.alive && (t.p[0] == p || t.p[1] == p || t.p[2] == p) && find(out.begin(), out.end(), list[i]) == out.end())
+                out.push_back(list[i]);
+        }
+    }
+
+    void pushCandidates(unsigned int p)
+    {
+        vector<unsigned int> tris;
+        around(p, tris);
+        for (size_t i = 0; i < tris.size(); i++)
+        {
+            const Triangle& t = triangles[tris[i]];
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int q = t.p[c];
+                if (q == p)
+                    continue;
+                pushCandidate(p, q);
+                pushCandidate(q, p);
+            }
+        }
+    }
+
+    void pushCandidate(unsigned int from, unsigned int to)
+    {
+        if (kinds[from] == KIND_LOCKED)
+            return;
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        Candidate c = { q.evaluate(positions[to]), from, to, stamps[from], stamps[to] };
+        heap.push(c);
+    }
+
+    bool contains(const Triangle& t, unsigned int p) const
+    {
+        return t.p[0] == p || t.p[1] == p || t.p[2] == p;
+    }
+
+    unsigned int wedgeAt(const Triangle& t, unsigned int p) const
+    {
+        for (int c = 0; c < 3; c++)
+            if (t.p[c] == p)
+                return t.w[c];
+        return ~0u;
+    }
+
+    bool canCollapse(unsigned int u, unsigned int v, const vector<unsigned int>& aroundU, const vector<unsigned int>& shared)
+    {
+        if (shared.empty())
+            return false;
+        Kind ku = kinds[u], kv = kinds[v];
+        if (ku == KIND_BORDER && (shared.size() != 1 || (kv != KIND_BORDER && kv != KIND_LOCKED)))
+            return false;
+        if (ku == KIND_SEAM)
+        {
+            if (shared.size() != 2 || (kv != KIND_SEAM && kv != KIND_LOCKED))
+                return false;
+            // only along the seam: the two sides of the edge use different attributes at u
+            if (wedgeAt(triangles[shared[0]], u) == wedgeAt(triangles[shared[1]], u))
+                return false;
+        }
+        if (ku == KIND_MANIFOLD && shared.size() != 2)
+            return false;
+
+        // link condition: u and v may only share the neighbors of the collapsing edge,
+        // anything else would pinch the surface into a non-manifold fold
+        vector<unsigned int> nu, nv, aroundV;
+        around(v, aroundV);
+        for (size_t i = 0; i < aroundU.size(); i++)
+            for (int c = 0; c < 3; c++)
+                nu.push_back(triangles[aroundU[i]].p[c]);
+        for (size_t i = 0; i < aroundV.size(); i++)
+            for (int c = 0; c < 3; c++)
+                nv.push_back(triangles[aroundV[i]].p[c]);
+        sort(nu.begin(), nu.end());
+        nu.erase(unique(nu.begin(), nu.end()), nu.end());
+        sort(nv.begin(), nv.end());
+        nv.erase(unique(nv.begin(), nv.end()), nv.end());
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < nu.size() && j < nv.size();)
+        {
+            if (nu[i] < nv[j])
+                i++;
+            else if (nv[j] < nu[i])
+                j++;
+            else
+            {
+                if (nu[i] != u && nu[i] != v)
+                    common++;
+                i++;
+                j++;
+            }
+        }
+        if (common != shared.size())
+            return false;
+
+        // no triangle around u may flip or collapse to a sliver once u sits on v
+        for (size_t i = 0; i < aroundU.size(); i++)
+        {
+            const Triangle& t = triangles[aroundU[i]];
+            if (contains(t, v))
+                continue;
+            glm::vec3 before = faceNormal(t);
+            Triangle moved = t;
+            for (int c = 0; c < 3; c++)
+                if (moved.p[c] == u)
+                    moved.p[c] = v;
+            glm::vec3 after = faceNormal(moved);
+            float lb = glm::length(before), la = glm::length(after);
+            if (la <= 1e-12f * (lb + 1e-30f) || glm::dot(before, after) < 0.2f * lb * la)
+                return false;
+        }
+        return true;
+    }
+
+    void collapse(unsigned int u, unsigned int v, const vector<unsigned int>& aroundU, const vector<unsigned int>& shared)
+    {
+        // where u's attributes go: each side of the edge maps onto v's attributes on that side
+        unsigned int fromA = wedgeAt(triangles[shared[0]], u), toA = wedgeAt(triangles[shared[0]], v);
+        unsigned int fromB = shared.size() > 1 ? wedgeAt(triangles[shared[1]], u) : fromA;
+        unsigned int toB = shared.size() > 1 ? wedgeAt(triangles[shared[1]], v) : toA;
+
+        for (size_t i = 0; i < aroundU.size(); i++)
+        {
+            Triangle& t = triangles[aroundU[i]];
+            if (contains(t, v))
+            {
+                t.alive = false;
+                aliveTriangles--;
+                continue;
+            }
+            for (int c = 0; c < 3; c++)
+                if (t.p[c] == u)
+                {
+                    t.p[c] = v;
+                    t.w[c] = t.w[c] == fromB && fromB != fromA ? toB : toA;
+                }
+            incident[v].push_back(aroundU[i]);
+        }
+
+        quadrics[v].add(quadrics[u]);
+        removed[u] = true;
+        stamps[u]++;
+        stamps[v]++;
+        pushCandidates(v);
+    }
+
+    // collapses the cheapest edges until the target triangle count or the error limit (squared) is reached.
+    // returns the error of the mesh at that point.
+    float simplify(size_t target, float errorLimit2)
+    {
+        vector<unsigned int> aroundU, shared;
+        while (aliveTriangles > target && !heap.empty())
+        {
+            Candidate c = heap.top();
+            if (c.cost > errorLimit2)
+                break;
+            heap.pop();
+            if (removed[c.from] || removed[c.to] || c.fromStamp != stamps[c.from] || c.toStamp != stamps[c.to])
+                continue;
+
+            around(c.from, aroundU);
+            shared.clear();
+            for (size_t i = 0; i < aroundU.size(); i++)
+                if (contains(triangles[aroundU[i]], c.to))
+                    shared.push_back(aroundU[i]);
+            if (!canCollapse(c.from, c.to, aroundU, shared))
+                continue;
+            collapse(c.from, c.to, aroundU, shared);
+            maxCost = max(maxCost, c.cost);
+        }
+        return static_cast<float>(sqrt(maxCost));
+    }
+
+    // the alive triangles as a new level: fresh vertices with recomputed face normals, optimized like
+    // the full mesh and appended to it
+    void appendLod(MeshData& mesh, float error) const
+    {
+        MeshData lod;
+        struct Key {
+            unsigned int wedge;
+            glm::vec3 faceNormal;
+            bool operator==(const Key& o) const { return wedge == o.wedge && memcmp(&faceNormal, &o.faceNormal, sizeof(faceNormal)) == 0; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& k) const
+            {
+                unsigned int b[3];
+                memcpy(b, &k.faceNormal, sizeof(b));
+                return k.wedge * 2654435761u ^ b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u;
+            }
+        };
+        unordered_map<Key, unsigned int, KeyHash> unique;
+        for (size_t t = 0; t < triangles.size(); t++)
+        {
+            const Triangle& tri = triangles[t];
+            if (!tri.alive)
+                continue;
+            glm::vec3 n = glm::normalize(faceNormal(tri));
+            for (int c = 0; c < 3; c++)
+            {
+                Key key = { tri.w[c], n };
+                pair<unordered_map<Key, unsigned int, KeyHash>::iterator, bool> slot =
+                    unique.insert(make_pair(key, static_cast<unsigned int>(lod.vertices.size())));
+                if (slot.second)
+                {
+                    Vertex vertex = wedges[tri.w[c]];
+                    vertex.Position = positions[tri.p[c]];
+                    vertex.FaceNormal = n;
+                    lod.vertices.push_back(vertex);
+                }
+                lod.indices.push_back(slot.first->second);
+            }
+        }
+        MeshOptimizer::optimize(lod);
+
+        unsigned int base = static_cast<unsigned int>(mesh.vertices.size());
+        MeshLod range = { static_cast<unsigned int>(mesh.indices.size()), static_cast<unsigned int>(lod.indices.size()), error, 0, 0 };
+        mesh.vertices.insert(mesh.vertices.end(), lod.vertices.begin(), lod.vertices.end());
+        for (size_t i = 0; i < lod.indices.size(); i++)
+            mesh.indices.push_back(base + lod.indices[i]);
+        mesh.lods.push_back(range);
+    }
+};
+#endif
@@ -0,0 +1,155 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHLET_SSE2 1
+#endif
+
+// a cluster of at most MESHLET_MAX_VERTICES vertices / MESHLET_MAX_TRIANGLES triangles, stored as a
+// contiguous range of its mesh's index buffer. stored as is in the mesh cache.
+struct Meshlet {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    glm::vec3    center;     // bounding sphere
+    float        radius;
+    glm::vec3    coneAxis;   // average facing of the triangles
+    float        coneCutoff; // sine of the cone's half angle, 1 when the cone can't cull anything
+};
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// the meshlet bounds as a structure of arrays, padded to a multiple of 4 so the SSE2 path can load whole lanes
+struct MeshletBounds {
+    vector<float> cx, cy, cz, radius;
+    vector<float> ax, ay, az, cutoff;
+
+    void assign(const vector<Meshlet>& meshlets)
+    {
+        size_t padded = (meshlets.size() + 3) & ~static_cast<size_t>(3);
+        vector<float>* lanes[8] = { &cx, &cy, &cz, &radius, &ax, &ay, &az, &cutoff };
+        for (int l = 0; l < 8; l++)
+            lanes[l]->assign(padded, 0.0f);
+        for (size_t i = 0; i < meshlets.size(); i++)
+        {
+            const Meshlet& m = meshlets[i];
+            cx[i] = m.center.x;
+            cy[i] = m.center.y;
+            cz[i] = m.center.z;
+            radius[i] = m.radius;
+            ax[i] = m.coneAxis.x;
+            ay[i] = m.coneAxis.y;
+            az[i] = m.coneAxis.z;
+            cutoff[i] = m.coneCutoff;
+        }
+    }
+};
+
+struct MeshletCullStats {
+    size_t meshlets = 0;
+    size_t visibleMeshlets = 0;
+    size_t triangles = 0;
+    size_t visibleTriangles = 0;
+
+    void add(const MeshletCullStats& other)
+    {
+        meshlets += other.meshlets;
+        visibleMeshlets += other.visibleMeshlets;
+        triangles += other.triangles;
+        visibleTriangles += other.visibleTriangles;
+    }
+};
+
+// per-frame visibility of meshlets: outside the frustum, or facing away from the camera as a whole.
+// everything happens in model space, so a mesh's bounds never need transforming.
+class MeshletCuller
+{
+public:
+    // the six clip planes of a model-view-projection matrix (Gribb, Hartmann) in the model's space.
+    // xyz is normalized, a point p is inside when dot(xyz, p) + w >= 0 for all of them.
+    static void frustumPlanes(const glm::mat4& mvp, glm::vec4 planes[6])
+    {
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; r++)
+            rows[r] = glm::vec4(mvp[0][r], mvp[1][r], mvp[2][r], mvp[3][r]);
+        planes[0] = rows[3] + rows[0]; // left
+        planes[1] = rows[3] - rows[0]; // right
+        planes[2] = rows[3] + rows[1]; // bottom
+        planes[3] = rows[3] - rows[1]; // top
+        planes[4] = rows[3] + rows[2]; // near
+        planes[5] = rows[3] - rows[2]; // far
+        for (int p = 0; p < 6; p++)
+        {
+            float length = glm::length(glm::vec3(planes[p]));
+            if (length > 0.0f)
+                planes[p] = planes[p] / length;
+        }
+    }
+
+    // visible[i] = 1 for each visible meshlet in [first, first + count). camera is in model space,
+    // with backfaces false only the frustum test is applied.
+    static void cull(const MeshletBounds& b, size_t first, size_t count, const glm::vec4 planes[6], const glm::vec3& camera,
+                     bool backfaces, unsigned char* visible)
+    {
+        size_t i = 0;
+#ifdef MESHLET_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 camX = _mm_set1_ps(camera.x), camY = _mm_set1_ps(camera.y), camZ = _mm_set1_ps(camera.z);
+        for (; i + 4 <= count; i += 4)
+        {
+            size_t m = first + i;
+            __m128 x = _mm_loadu_ps(&b.cx[m]), y = _mm_loadu_ps(&b.cy[m]), z = _mm_loadu_ps(&b.cz[m]);
+            __m128 r = _mm_loadu_ps(&b.radius[m]);
+            __m128 negR = _mm_sub_ps(zero, r);
+
+            // outside when the center is further than the radius behind any plane
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(planes[p].y))),
+                                      _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+            }
+
+            if (backfaces)
+            {
+                // backfacing when dot(c - camera, axis) >= cutoff * |c - camera| + r
+                __m128 vx = _mm_sub_ps(x, camX), vy = _mm_sub_ps(y, camY), vz = _mm_sub_ps(z, camZ);
+                __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&b.ax[m])), _mm_mul_ps(vy, _mm_loadu_ps(&b.ay[m]))),
+                                          _mm_mul_ps(vz, _mm_loadu_ps(&b.az[m])));
+                __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+                __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&b.cutoff[m]), distance), r);
+                inside = _mm_andnot_ps(_mm_cmpge_ps(along, limit), inside);
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            visible[i] = mask & 1;
+            visible[i + 1] = (mask >> 1) & 1;
+            visible[i + 2] = (mask >> 2) & 1;
+            visible[i + 3] = (mask >> 3) & 1;
+        }
+#endif
+        for (; i < count; i++)
+        {
+            size_t m = first + i;
+            glm::vec3 c(b.cx[m], b.cy[m], b.cz[m]);
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+                inside = glm::dot(glm::vec3(planes[p]), c) + planes[p].w >= -b.radius[m];
+            if (inside && backfaces)
+            {
+                glm::vec3 v = c - camera;
+                inside = glm::dot(v, glm::vec3(b.ax[m], b.ay[m], b.az[m])) < b.cutoff[m] * glm::length(v) + b.radius[m];
+            }
+            visible[i] = inside ? 1 : 0;
+        }
+    }
+};
+#endif
@@ -0,0 +1,277 @@
+#ifndef MESHLET_BUILDER_H
+#define MESHLET_BUILDER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// how much a triangle's deviation from the meshlet's facing weighs against adding a new vertex
+const float MESHLET_CONE_WEIGHT = 2.0f;
+// triangles facing more than ~37 degrees away from a meshlet's average start a new one. smaller,
+// tighter meshlets cull far better on curved hulls, the draw ranges of neighbours merge again anyway.
+const float MESHLET_CONE_LIMIT = 0.8f;
+
+// splits every level of detail of a mesh into meshlets and rewrites its index ranges so each meshlet
+// is contiguous. meshlets grow over shared vertices and prefer triangles facing the same way, which
+// keeps the normal cones narrow enough to cull whole flat panels.
+class MeshletBuilder
+{
+public:
+    static void build(MeshData& mesh)
+    {
+        mesh.meshlets.clear();
+        if (mesh.lods.empty())
+        {
+            MeshLod full = { 0, static_cast<unsigned int>(mesh.indices.size()), 0.0f, 0, 0 };
+            mesh.lods.push_back(full);
+        }
+        for (size_t l = 0; l < mesh.lods.size(); l++)
+        {
+            MeshLod& lod = mesh.lods[l];
+            lod.firstMeshlet = static_cast<unsigned int>(mesh.meshlets.size());
+            buildRange(mesh.vertices, mesh.indices, lod.firstIndex, lod.indexCount, mesh.meshlets);
+            lod.meshletCount = static_cast<unsigned int>(mesh.meshlets.size()) - lod.firstMeshlet;
+        }
+    }
+
+private:
+    struct PositionHash {
+        size_t operator()(const glm::vec3& v) const
+        {
+            unsigned int b[3];
+            memcpy(b, &v, sizeof(b));
+            return b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u;
+        }
+    };
+
+    struct PositionEqual {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const { return memcmp(&a, &b, sizeof(a)) == 0; }
+    };
+
+    static void buildRange(const vector<Vertex>& vertices, vector<unsigned int>& indices, unsigned int firstIndex, unsigned int indexCount,
+                           vector<Meshlet>& meshlets)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (!triangleCount)
+            return;
+        const unsigned int* tri = &indices[firstIndex];
+
+        // vertices this range uses, and their positions welded. triangles are adjacent through shared
+        // positions, vertices split by face normal would otherwise keep every triangle on its own.
+        vector<unsigned int> local(vertices.size(), ~0u);
+        vector<unsigned int> weldedOf;
+        unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> welded;
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            if (local[tri[i]] == ~0u)
+            {
+                local[tri[i]] = static_cast<unsigned int>(weldedOf.size());
+                weldedOf.push_back(welded.insert(make_pair(vertices[tri[i]].Position, static_cast<unsigned int>(welded.size()))).first->second);
+            }
+
+        // position -> triangle adjacency
+        vector<unsigned int> offsets(welded.size() + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            offsets[weldedOf[local[tri[i]]] + 1]++;
+        for (size_t v = 0; v < welded.size(); v++)
+            offsets[v + 1] += offsets[v];
+        vector<unsigned int> adjacency(triangleCount * 3);
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int c = 0; c < 3; c++)
+                adjacency[fill[weldedOf[local[tri[t * 3 + c]]]]++] = static_cast<unsigned int>(t);
+
+        vector<glm::vec3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& a = vertices[tri[t * 3]].Position;
+            glm::vec3 n = glm::cross(vertices[tri[t * 3 + 1]].Position - a, vertices[tri[t * 3 + 2]].Position - a);
+            float length = glm::length(n);
+            normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+        }
+
+        vector<bool> emitted(triangleCount, false);
+        vector<unsigned int> owner(weldedOf.size(), ~0u);      // meshlet a vertex was last added to
+        vector<unsigned int> positionOwner(welded.size(), ~0u); // same for positions
+        vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        vector<Meshlet> built;
+        vector<unsigned int> members;  // positions of the current meshlet, the search front
+        unsigned int vertexCount = 0;  // vertices of the current meshlet
+        size_t cursor = 0;
+
+        while (true)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor == triangleCount)
+                break;
+
+            unsigned int id = static_cast<unsigned int>(built.size());
+            Meshlet meshlet;
+            meshlet.firstIndex = firstIndex + static_cast<unsigned int>(result.size());
+            members.clear();
+            vertexCount = 0;
+            glm::vec3 facing(0.0f);
+            size_t triangles = 0;
+
+            size_t next = cursor;
+            while (true)
+            {
+                emitted[next] = true;
+                triangles++;
+                facing += normals[next];
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int v = local[tri[next * 3 + c]];
+                    result.push_back(tri[next * 3 + c]);
+                    if (owner[v] != id)
+                    {
+                        owner[v] = id;
+                        vertexCount++;
+                    }
+                    if (positionOwner[weldedOf[v]] != id)
+                    {
+                        positionOwner[weldedOf[v]] = id;
+                        members.push_back(weldedOf[v]);
+                    }
+                }
+                if (triangles == MESHLET_MAX_TRIANGLES)
+                    break;
+
+                // the unemitted neighbor that adds the fewest vertices and bends the cone the least
+                float axisLength = glm::length(facing);
+                glm::vec3 axis = axisLength > 0.0f ? facing / axisLength : glm::vec3(0.0f);
+                float bestScore = 1e30f;
+                size_t best = triangleCount;
+                for (size_t m = 0; m < members.size(); m++)
+                {
+                    unsigned int v = members[m];
+                    for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++)
+                    {
+                        unsigned int t = adjacency[a];
+                        if (emitted[t])
+                            continue;
+                        unsigned int added = 0;
+                        for (int c = 0; c < 3; c++)
+                            added += owner[local[tri[t * 3 + c]]] != id;
+                        if (vertexCount + added > MESHLET_MAX_VERTICES)
+                            continue;
+                        float facingDot = glm::dot(normals[t], axis);
+                        if (facingDot < MESHLET_CONE_LIMIT)
+                            continue;
+                        float score = added + MESHLET_CONE_WEIGHT * (1.0f - facingDot);
+                        if (score < bestScore)
+                        {
+                            bestScore = score;
+                            best = t;
+                        }
+                    }
+                }
+                if (best == triangleCount)
+                    break;
+                next = best;
+            }
+
+            meshlet.indexCount = static_cast<unsigned int>(triangles * 3);
+            bound(vertices, &result[meshlet.firstIndex - firstIndex], meshlet.indexCount, meshlet);
+            cone(vertices, &result[meshlet.firstIndex - firstIndex], meshlet.indexCount, meshlet);
+            built.push_back(meshlet);
+        }
+
+        // cache order inside each meshlet, meshlets outside-in like MeshOptimizer's clusters
+        glm::vec3 center(0.0f);
+        for (size_t m = 0; m < built.size(); m++)
+            center += built[m].center;
+        center /= static_cast<float>(built.size());
+
+        vector<unsigned int> order(built.size());
+        for (size_t m = 0; m < order.size(); m++)
+            order[m] = static_cast<unsigned int>(m);
+        stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            return glm::dot(built[a].center - center, built[a].coneAxis) > glm::dot(built[b].center - center, built[b].coneAxis);
+        });
+
+        unsigned int* out = &indices[firstIndex];
+        size_t written = 0;
+        vector<unsigned int> clusters, meshletIndices, meshletVertices;
+        for (size_t o = 0; o < order.size(); o++)
+        {
+            Meshlet meshlet = built[order[o]];
+            const unsigned int* src = &result[meshlet.firstIndex - firstIndex];
+
+            // reordered on meshlet-local vertex numbers, the meshlet has at most 64 of them
+            meshletVertices.clear();
+            meshletIndices.resize(meshlet.indexCount);
+            for (unsigned int i = 0; i < meshlet.indexCount; i++)
+            {
+                size_t v = find(meshletVertices.begin(), meshletVertices.end(), src[i]) - meshletVertices.begin();
+                if (v == meshletVertices.size())
+                    meshletVertices.push_back(src[i]);
+                meshletIndices[i] = static_cast<unsigned int>(v);
+            }
+            MeshOptimizer::optimizeVertexCache(meshletIndices, meshletVertices.size(), clusters);
+            for (unsigned int i = 0; i < meshlet.indexCount; i++)
+                out[written + i] = meshletVertices[meshletIndices[i]];
+            meshlet.firstIndex = firstIndex + static_cast<unsigned int>(written);
+            written += meshlet.indexCount;
+            meshlets.push_back(meshlet);
+        }
+    }
+
+    // sphere around the meshlet's box
+    static void bound(const vector<Vertex>& vertices, const unsigned int* indices, unsigned int count, Meshlet& meshlet)
+    {
+        glm::vec3 lo = vertices[indices[0]].Position, hi = lo;
+        for (unsigned int i = 1; i < count; i++)
+        {
+            lo = glm::min(lo, vertices[indices[i]].Position);
+            hi = glm::max(hi, vertices[indices[i]].Position);
+        }
+        meshlet.center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (unsigned int i = 0; i < count; i++)
+            radius = max(radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+        meshlet.radius = radius;
+    }
+
+    // axis = average facing, cutoff = sine of the widest angle between it and a triangle. cones wider
+    // than about 84 degrees are left uncullable.
+    static void cone(const vector<Vertex>& vertices, const unsigned int* indices, unsigned int count, Meshlet& meshlet)
+    {
+        glm::vec3 sum(0.0f);
+        vector<glm::vec3> normals;
+        for (unsigned int i = 0; i + 2 < count; i += 3)
+        {
+            const glm::vec3& a = vertices[indices[i]].Position;
+            glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                continue;
+            normals.push_back(n / length);
+            sum += n / length;
+        }
+        float length = glm::length(sum);
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+        if (normals.empty() || length <= 0.0f)
+            return;
+        glm::vec3 axis = sum / length;
+        float minDot = 1.0f;
+        for (size_t i = 0; i < normals.size(); i++)
+            minDot = min(minDot, glm::dot(axis, normals[i]));
+        if (minDot <= 0.1f)
+            return;
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+    }
+};
+#endif
@@ -0,0 +1,424 @@
+#ifndef MODEL_BATCH_H
+#define MODEL_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "mesh.h"
+#include "Material.h"
+#include "model.h"
+#include "RenderQueue.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// the command layout glMultiDrawElementsIndirect reads
+// what a batch draw binds, see ModelBatch::submit
+enum Batch_Draw {
+    BATCH_ALL,        // every command in one draw, all attributes
+    BATCH_DEPTH_ONLY, // every command in one draw, positions only
+    BATCH_MATERIALS   // one draw per material
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// the meshes of one or more models suballocated from one vertex and one index buffer behind a single VAO.
+// every pass is one multi-draw per material, or a single one when materials don't matter, instead of a
+// bind and a draw call per mesh. the models stay the owners of their meshes: visibility, level of detail
+// and meshlet culling are read from them by update(). build() frees the meshes' own buffers, the batch
+// holds the only copy of the geometry on the GPU.
+class ModelBatch
+{
+public:
+    VertexFormat format; // GPU layout of the arenas
+    size_t gpuBytes = 0;
+
+    ModelBatch(VertexFormat format = VertexFormat::compact()) : format(format) {}
+
+    ~ModelBatch()
+    {
+        clear();
+    }
+
+    // forgets every mesh and frees the buffers, the batch can then be filled again
+    void clear()
+    {
+        if (VAO)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteVertexArrays(1, &depthVAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+        }
+        if (positionVBO)
+            glDeleteBuffers(1, &positionVBO);
+        if (indirectBuffer)
+            glDeleteBuffers(1, &indirectBuffer);
+        VAO = depthVAO = VBO = EBO = positionVBO = indirectBuffer = 0;
+        entries.clear();
+        buckets.clear();
+        commands.clear();
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+        gpuBytes = 0;
+        positionScale = glm::vec3(1.0f, 1.0f, 1.0f);
+        positionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+    }
+
+    // queues the meshes of a model. world places them relative to the other models of the batch, the
+    // draw calls still apply the shader's model matrix on top. call build() once everything is added.
+    void add(Model& model, const glm::mat4& world = glm::mat4(1.0f))
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            Entry entry;
+            entry.mesh = &model.meshes[i];
+            entry.world = world;
+            entries.push_back(entry);
+        }
+    }
+
+    // uploads the queued meshes into the shared buffers
+    void build()
+    {
+        // the arenas, in batch space
+        vector<Vertex> vertices;
+        size_t indexCount = 0;
+        bool shortIndices = format.shortIndices;
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+            const Mesh& mesh = *entries[e].mesh;
+            indexCount += mesh.indices.size();
+            shortIndices = shortIndices && mesh.vertices.size() <= 65536;
+        }
+        indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        size_t indexSize = shortIndices ? sizeof(unsigned short) : sizeof(unsigned int);
+        vector<unsigned char> indices(indexCount * indexSize);
+
+        map<unsigned int, unsigned int> materials; // material -> bucket
+        size_t written = 0;
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+            Entry& entry = entries[e];
+            const Mesh& mesh = *entry.mesh;
+            entry.firstIndex = static_cast<unsigned int>(written);
+            entry.baseVertex = static_cast<GLint>(vertices.size());
+
+            // indices stay mesh-local, the commands add the base vertex
+            for (size_t i = 0; i < mesh.indices.size(); i++)
+            {
+                if (shortIndices)
+                {
+                    unsigned short index = static_cast<unsigned short>(mesh.indices[i]);
+                    memcpy(&indices[(written + i) * indexSize], &index, sizeof(index));
+                }
+                else
+                    memcpy(&indices[(written + i) * indexSize], &mesh.indices[i], sizeof(unsigned int));
+            }
+            written += mesh.indices.size();
+            appendVertices(mesh, entry.world, vertices);
+
+            map<unsigned int, unsigned int>::iterator found = materials.find(mesh.material);
+            if (found == materials.end())
+            {
+                found = materials.insert(make_pair(mesh.material, static_cast<unsigned int>(buckets.size()))).first;
+                Bucket bucket;
+                bucket.material = mesh.material;
+                buckets.push_back(bucket);
+            }
+            buckets[found->second].entries.push_back(static_cast<unsigned int>(e));
+        }
+
+        if (format.position == POSITION_SNORM16 && !vertices.empty())
+            VertexPacker::snormRange(vertices.data(), vertices.size(), positionScale, positionOffset);
+        VertexPacker packer(format, positionScale, positionOffset);
+        vector<unsigned char> attributes(vertices.size() * packer.stride);
+        vector<unsigned char> positions(format.splitPositions ? vertices.size() * packer.positionSize : 0);
+        packer.pack(vertices.data(), vertices.size(), attributes.data(), format.splitPositions ? positions.data() : NULL);
+
+        glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, attributes.size(), attributes.data(), GL_STATIC_DRAW);
+        gpuBytes = indices.size() + attributes.size() + positions.size();
+        packer.attributePointers();
+
+        unsigned int positionBuffer = VBO;
+        if (format.splitPositions)
+        {
+            glGenBuffers(1, &positionVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+            positionBuffer = positionVBO;
+        }
+        packer.positionPointer();
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        packer.positionPointer();
+        glBindVertexArray(0);
+
+        // indirect draws are core in 4.3, older contexts get the same commands through glMultiDrawElementsBaseVertex
+        indirect = GLAD_GL_VERSION_4_3 != 0;
+        if (indirect)
+            glGenBuffers(1, &indirectBuffer);
+
+        // nothing draws from the per-mesh buffers anymore, the arenas above have everything
+        for (size_t e = 0; e < entries.size(); e++)
+            entries[e].mesh->releaseBuffers();
+
+        cout << "model batch: " << entries.size() << " meshes, " << buckets.size() << " materials, "
+             << vertices.size() << " vertices, " << indexCount / 3 << " triangles" << endl;
+    }
+
+    // records this frame's draw commands from the meshes' visibility, level of detail and meshlet culling,
+    // each material's meshes front to back as seen through modelView (the model matrix the passes use
+    // times the view). call once per frame after those are updated, before the passes.
+    void update(const glm::mat4& modelView = glm::mat4(1.0f))
+    {
+        commands.clear();
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            Bucket& bucket = buckets[b];
+            bucket.firstCommand = commands.size();
+            nearest.clear();
+            for (size_t i = 0; i < bucket.entries.size(); i++)
+            {
+                const Entry& entry = entries[bucket.entries[i]];
+                if (entry.mesh->visible)
+                    nearest.push_back(make_pair(depthOf(entry, modelView), bucket.entries[i]));
+            }
+            std::sort(nearest.begin(), nearest.end());
+            bucket.depth = nearest.empty() ? 0.0f : nearest[0].first;
+            for (size_t i = 0; i < nearest.size(); i++)
+            {
+                const Entry& entry = entries[nearest[i].second];
+                firsts.clear();
+                rangeCounts.clear();
+                entry.mesh->drawRanges(firsts, rangeCounts);
+                for (size_t r = 0; r < firsts.size(); r++)
+                {
+                    DrawElementsIndirectCommand command = { rangeCounts[r], 1, entry.firstIndex + firsts[r], entry.baseVertex, 0 };
+                    commands.push_back(command);
+                    counts.push_back(static_cast<GLsizei>(command.count));
+                    offsets.push_back((const void*)(command.firstIndex * indexSize));
+                    baseVertices.push_back(command.baseVertex);
+                }
+            }
+            bucket.commandCount = commands.size() - bucket.firstCommand;
+        }
+
+        if (indirect && !commands.empty())
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    // queues this frame's draws for a pass of queue: one item, or one per material with BATCH_MATERIALS
+    // (without the meshes that have none).
+    // the batch must outlive the queue's execute().
+    void submit(RenderQueue& queue, unsigned int pass, const Shader& shader, Batch_Draw draw)
+    {
+        if (commands.empty())
+            return;
+        RenderItem item;
+        item.shader = &shader;
+        item.owner = this;
+        if (draw != BATCH_MATERIALS)
+        {
+            item.vao = draw == BATCH_DEPTH_ONLY ? depthVAO : VAO;
+            item.issue = issueAll;
+            item.key = RenderQueue::makeKey(pass, shader.ID, MATERIAL_NONE, item.vao, nearestDepth());
+            queue.submit(item);
+            return;
+        }
+        item.vao = VAO;
+        item.issue = issueBucket;
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            if (!buckets[b].commandCount || buckets[b].material == MATERIAL_NONE)
+                continue;
+            item.material = buckets[b].material;
+            item.argument = b;
+            item.key = RenderQueue::makeKey(pass, shader.ID, item.material, item.vao, buckets[b].depth);
+            queue.submit(item);
+        }
+    }
+
+    // every command in one draw, materials aside
+    void DrawToBuffer(Shader& shader)
+    {
+        setPositionDecode(shader);
+        GLState::instance().bindVertexArray(VAO);
+        multiDraw(0, commands.size());
+    }
+
+    // same with only the position stream bound
+    void DrawDepthOnly(Shader& shader)
+    {
+        setPositionDecode(shader);
+        GLState::instance().bindVertexArray(depthVAO);
+        multiDraw(0, commands.size());
+    }
+
+    // one draw per material, meshes without one are left out
+    void Draw(Shader& shader)
+    {
+        MaterialTable& materials = MaterialTable::instance();
+        materials.begin();
+        setPositionDecode(shader);
+        GLState::instance().bindVertexArray(VAO);
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            if (!buckets[b].commandCount || buckets[b].material == MATERIAL_NONE)
+                continue;
+            materials.apply(shader, buckets[b].material);
+            multiDraw(buckets[b].firstCommand, buckets[b].commandCount);
+        }
+    }
+
+    // draw commands recorded by the last update()
+    size_t commandCount() const
+    {
+        return commands.size();
+    }
+
+private:
+    ModelBatch(const ModelBatch&);
+    ModelBatch& operator=(const ModelBatch&);
+
+    struct Entry {
+        Mesh*        mesh = NULL;
+        glm::mat4    world = glm::mat4(1.0f);
+        unsigned int firstIndex = 0; // in the index arena
+        GLint        baseVertex = 0;
+    };
+
+    struct Bucket {
+        unsigned int         material = 0; // in MaterialTable, shared by every mesh of the bucket
+        vector<unsigned int> entries;
+        size_t               firstCommand = 0;
+        size_t               commandCount = 0;
+        float                depth = 0.0f; // of its nearest visible mesh, this frame
+    };
+
+    unsigned int VAO = 0, depthVAO = 0;
+    unsigned int VBO = 0, EBO = 0, positionVBO = 0;
+    unsigned int indirectBuffer = 0;
+    bool         indirect = false;
+    GLenum       indexType = GL_UNSIGNED_INT;
+    glm::vec3    positionScale = glm::vec3(1.0f, 1.0f, 1.0f);
+    glm::vec3    positionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    vector<Entry>  entries;
+    vector<Bucket> buckets;
+    vector<DrawElementsIndirectCommand> commands;
+    // the same commands for glMultiDrawElementsBaseVertex
+    vector<GLsizei>     counts;
+    vector<const void*> offsets;
+    vector<GLint>       baseVertices;
+    vector<unsigned int> firsts, rangeCounts; // scratch for Mesh::drawRanges
+    vector<pair<float, unsigned int> > nearest; // scratch for update: depth, entry
+
+    // view-space distance to the nearest point of the mesh's bounding sphere
+    static float depthOf(const Entry& entry, const glm::mat4& modelView)
+    {
+        glm::mat4 toView = modelView * entry.world;
+        glm::vec4 center = toView * glm::vec4(entry.mesh->boundsCenter, 1.0f);
+        return -center.z - entry.mesh->boundsRadius * glm::length(glm::vec3(toView[0]));
+    }
+
+    float nearestDepth() const
+    {
+        float depth = 0.0f;
+        bool first = true;
+        for (size_t b = 0; b < buckets.size(); b++)
+            if (buckets[b].commandCount)
+            {
+                depth = first ? buckets[b].depth : std::min(depth, buckets[b].depth);
+                first = false;
+            }
+        return depth;
+    }
+
+    static void issueAll(void* owner, const Shader& shader, size_t)
+    {
+        ModelBatch* batch = static_cast<ModelBatch*>(owner);
+        batch->setPositionDecode(shader);
+        batch->multiDraw(0, batch->commands.size());
+    }
+
+    static void issueBucket(void* owner, const Shader& shader, size_t bucket)
+    {
+        ModelBatch* batch = static_cast<ModelBatch*>(owner);
+        batch->setPositionDecode(shader);
+        batch->multiDraw(batch->buckets[bucket].firstCommand, batch->buckets[bucket].commandCount);
+    }
+
+    static void appendVertices(const Mesh& mesh, const glm::mat4& world, vector<Vertex>& vertices)
+    {
+        size_t first = vertices.size();
+        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        if (world == glm::mat4(1.0f))
+            return;
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+        for (size_t i = first; i < vertices.size(); i++)
+        {
+            Vertex& v = vertices[i];
+            v.Position = glm::vec3(world * glm::vec4(v.Position, 1.0f));
+            v.Normal = glm::normalize(normalMatrix * v.Normal);
+            v.FaceNormal = glm::normalize(normalMatrix * v.FaceNormal);
+        }
+    }
+
+    void setPositionDecode(const Shader& shader)
+    {
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+    }
+
+    void multiDraw(size_t first, size_t count)
+    {
+        if (!count)
+            return;
+        if (indirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)(first * sizeof(DrawElementsIndirectCommand)),
+                                        static_cast<GLsizei>(count), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[first], indexType, &offsets[first], static_cast<GLsizei>(count),
+                                          &baseVertices[first]);
+    }
+};
+#endif
@@ -0,0 +1,595 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "FaceFrames.h"
+#include "MappedFile.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// native reader for wavefront .obj/.mtl files, the format most of our assets come in.
+//
+// the file is memory-mapped and split into chunks on line boundaries, the chunks are parsed in parallel
+// and the meshes (one per object/material run, in file order, like assimp splits them) are then built in
+// parallel too. the output matches what Model::processMesh makes of assimp's import with
+// MODEL_IMPORT_FLAGS: triangulated faces, smooth normals where the file has none, flipped uvs, and the
+// face normal of every triangle in Vertex::FaceNormal. corners that agree on position, uv, normal and
+// face normal (flat panels) share a vertex instead of getting one each.
+class ObjLoader
+{
+public:
+    static bool load(const string& path, vector<MeshData>& meshes)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+            return false;
+
+        const char* data = reinterpret_cast<const char*>(file.data());
+        vector<Chunk> chunks = split(data, data + file.size());
+        ThreadPool::shared().parallelFor(chunks.size(), [&](size_t i) {
+            parseChunk(chunks[i]);
+        });
+
+        // prefix sums turn chunk-relative element counts into global offsets
+        Pools pools;
+        size_t positions = 0, texcoords = 0, normals = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            chunks[i].positionBase = positions;
+            chunks[i].texcoordBase = texcoords;
+            chunks[i].normalBase = normals;
+            positions += chunks[i].positions.size();
+            texcoords += chunks[i].texcoords.size();
+            normals += chunks[i].normals.size();
+        }
+        pools.positions.resize(positions);
+        pools.texcoords.resize(texcoords);
+        pools.normals.resize(normals);
+        pools.x.resize(positions);
+        pools.y.resize(positions);
+        pools.z.resize(positions);
+        pools.u.resize(texcoords);
+        pools.v.resize(texcoords);
+        ThreadPool::shared().parallelFor(chunks.size(), [&](size_t i) {
+            Chunk& chunk = chunks[i];
+            copy(chunk.positions.begin(), chunk.positions.end(), pools.positions.begin() + chunk.positionBase);
+            copy(chunk.texcoords.begin(), chunk.texcoords.end(), pools.texcoords.begin() + chunk.texcoordBase);
+            copy(chunk.normals.begin(), chunk.normals.end(), pools.normals.begin() + chunk.normalBase);
+            for (size_t p = 0; p < chunk.positions.size(); p++)
+            {
+                pools.x[chunk.positionBase + p] = chunk.positions[p].x;
+                pools.y[chunk.positionBase + p] = chunk.positions[p].y;
+                pools.z[chunk.positionBase + p] = chunk.positions[p].z;
+            }
+            for (size_t t = 0; t < chunk.texcoords.size(); t++)
+            {
+                pools.u[chunk.texcoordBase + t] = chunk.texcoords[t].x;
+                pools.v[chunk.texcoordBase + t] = chunk.texcoords[t].y;
+            }
+        });
+
+        // materials
+        string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        unordered_map<string, ObjMaterial> materials;
+        for (size_t i = 0; i < chunks.size(); i++)
+            for (size_t l = 0; l < chunks[i].libraries.size(); l++)
+                loadMaterials(directory + chunks[i].libraries[l], materials);
+
+        vector<Group> groups = groupFaces(chunks);
+        meshes.clear();
+        meshes.resize(groups.size());
+        ScratchArenas arenas;
+        ThreadPool::shared().parallelFor(groups.size(), [&](size_t i) {
+            ScratchArenas::Lease arena(arenas);
+            buildMesh(groups[i], chunks, pools, materials, *arena, meshes[i]);
+        });
+
+        // objects without any usable face don't become meshes, same as with assimp
+        meshes.erase(remove_if(meshes.begin(), meshes.end(), [](const MeshData& m) { return m.indices.empty(); }), meshes.end());
+        return !meshes.empty();
+    }
+
+    // fast decimal float parser, advances p past the number. handles sign, fraction and exponent.
+    static float parseFloat(const char*& p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        double value = 0.0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10.0 + (*p++ - '0');
+        if (p < end && *p == '.')
+        {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9')
+            {
+                value += (*p++ - '0') * scale;
+                scale *= 0.1;
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+            int exponent = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                exponent = exponent * 10 + (*p++ - '0');
+            value *= pow10(negativeExponent ? -exponent : exponent);
+        }
+        return static_cast<float>(negative ? -value : value);
+    }
+
+private:
+    struct ObjMaterial {
+        glm::vec3 diffuse = glm::vec3(0.6f, 0.6f, 0.6f); // assimp's default for obj materials
+        vector<TextureRef> textures;
+    };
+
+    // a face corner as written, components are 1-based, 0 when missing. a set bit in `relative`
+    // means the component was negative and holds (count at that line + index) inside the chunk.
+    struct RawCorner {
+        int v, t, n;
+        unsigned char relative;
+    };
+
+    struct Event {
+        size_t face;     // applies before this face of the chunk
+        bool   material; // usemtl, otherwise o/g
+        string name;
+    };
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        vector<glm::vec3> positions;
+        vector<glm::vec2> texcoords;
+        vector<glm::vec3> normals;
+        vector<RawCorner> corners;
+        vector<unsigned int> faceStarts;
+        vector<Event>  events;
+        vector<string> libraries;
+        size_t positionBase, texcoordBase, normalBase;
+    };
+
+    struct Pools {
+        vector<glm::vec3> positions;
+        vector<glm::vec2> texcoords;
+        vector<glm::vec3> normals;
+        vector<float>     x, y, z, u, v; // positions and texcoords once more as structures of arrays, for FaceFrames
+    };
+
+    struct FaceRange {
+        size_t chunk, first, last; // faces [first, last) of a chunk
+    };
+
+    struct Group {
+        string material;
+        vector<FaceRange> ranges;
+    };
+
+    struct Corner {
+        int v, t, n; // 0-based, -1 when missing
+    };
+
+    struct VertexKey {
+        int v, t, n;
+        glm::vec3 faceNormal;
+        bool operator==(const VertexKey& o) const
+        {
+            return v == o.v && t == o.t && n == o.n && memcmp(&faceNormal, &o.faceNormal, sizeof(faceNormal)) == 0;
+        }
+    };
+
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey& k) const
+        {
+            unsigned int bits[3];
+            memcpy(bits, &k.faceNormal, sizeof(bits));
+            size_t h = static_cast<size_t>(k.v) * 73856093u ^ static_cast<size_t>(k.t) * 19349663u ^ static_cast<size_t>(k.n) * 83492791u;
+            return h ^ (bits[0] * 2654435761u) ^ (bits[1] * 40503u) ^ (bits[2] * 2246822519u);
+        }
+    };
+
+    static double pow10(int exponent)
+    {
+        static const double table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+        double result = 1.0;
+        int e = exponent < 0 ? -exponent : exponent;
+        while (e > 15)
+        {
+            result *= 1e15;
+            e -= 15;
+        }
+        result *= table[e];
+        return exponent < 0 ? 1.0 / result : result;
+    }
+
+    // roughly 1MB per chunk, at least a few per worker, cut right after a newline
+    static vector<Chunk> split(const char* begin, const char* end)
+    {
+        size_t size = end - begin;
+        size_t target = max<size_t>(size / ((ThreadPool::shared().size() + 1) * 4), 1 << 20);
+        vector<Chunk> chunks;
+        const char* p = begin;
+        while (p < end)
+        {
+            const char* cut = p + min(target, static_cast<size_t>(end - p));
+            while (cut < end && *(cut - 1) != '\n')
+                cut++;
+            Chunk chunk;
+            chunk.begin = p;
+            chunk.end = cut;
+            chunks.push_back(chunk);
+            p = cut;
+        }
+        return chunks;
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // rest of the line without surrounding whitespace
+    static string restOfLine(const char* p, const char* lineEnd)
+    {
+        p = skipSpace(p, lineEnd);
+        const char* e = lineEnd;
+        while (e > p && (isSpace(*(e - 1)) || *(e - 1) == '\r'))
+            e--;
+        return string(p, e);
+    }
+
+    static bool keyword(const char* p, const char* lineEnd, const char* word)
+    {
+        size_t n = strlen(word);
+        return static_cast<size_t>(lineEnd - p) > n && memcmp(p, word, n) == 0 && isSpace(p[n]);
+    }
+
+    static int parseIndex(const char*& p, const char* end)
+    {
+        bool negative = false;
+        if (p < end && *p == '-')
+        {
+            negative = true;
+            p++;
+        }
+        int value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+        return negative ? -value : value;
+    }
+
+    // turns a raw index into chunk-relative form, see RawCorner
+    static int relativeIndex(int raw, size_t count, unsigned char bit, unsigned char& relative)
+    {
+        if (raw >= 0)
+            return raw;
+        relative |= bit;
+        return static_cast<int>(count) + raw;
+    }
+
+    static void parseChunk(Chunk& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            p = skipSpace(p, lineEnd);
+
+            if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+            {
+                p += 2;
+                glm::vec3 v;
+                v.x = parseFloat(p, lineEnd);
+                v.y = parseFloat(p, lineEnd);
+                v.z = parseFloat(p, lineEnd);
+                chunk.positions.push_back(v);
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+            {
+                p += 3;
+                glm::vec2 t;
+                t.x = parseFloat(p, lineEnd);
+                t.y = parseFloat(p, lineEnd);
+                chunk.texcoords.push_back(t);
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+            {
+                p += 3;
+                glm::vec3 n;
+                n.x = parseFloat(p, lineEnd);
+                n.y = parseFloat(p, lineEnd);
+                n.z = parseFloat(p, lineEnd);
+                chunk.normals.push_back(n);
+            }
+            else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+            {
+                p += 2;
+                unsigned int start = static_cast<unsigned int>(chunk.corners.size());
+                for (;;)
+                {
+                    p = skipSpace(p, lineEnd);
+                    if (p >= lineEnd || *p < '-' || *p > '9' || *p == '/' || *p == '.')
+                        break;
+                    RawCorner c = { 0, 0, 0, 0 };
+                    c.v = relativeIndex(parseIndex(p, lineEnd), chunk.positions.size(), 1, c.relative);
+                    if (p < lineEnd && *p == '/')
+                    {
+                        p++;
+                        if (p < lineEnd && *p != '/')
+                            c.t = relativeIndex(parseIndex(p, lineEnd), chunk.texcoords.size(), 2, c.relative);
+                        if (p < lineEnd && *p == '/')
+                        {
+                            p++;
+                            c.n = relativeIndex(parseIndex(p, lineEnd), chunk.normals.size(), 4, c.relative);
+                        }
+                    }
+                    chunk.corners.push_back(c);
+                    while (p < lineEnd && !isSpace(*p) && *p != '\r')
+                        p++;
+                }
+                if (chunk.corners.size() - start >= 3)
+                    chunk.faceStarts.push_back(start);
+                else
+                    chunk.corners.resize(start);
+            }
+            else if (keyword(p, lineEnd, "usemtl"))
+            {
+                Event e = { chunk.faceStarts.size(), true, restOfLine(p + 6, lineEnd) };
+                chunk.events.push_back(e);
+            }
+            else if (keyword(p, lineEnd, "o") || keyword(p, lineEnd, "g"))
+            {
+                Event e = { chunk.faceStarts.size(), false, restOfLine(p + 1, lineEnd) };
+                chunk.events.push_back(e);
+            }
+            else if (keyword(p, lineEnd, "mtllib"))
+                chunk.libraries.push_back(restOfLine(p + 6, lineEnd));
+
+            p = lineEnd + 1;
+        }
+    }
+
+    // walks the chunks in order and cuts the face stream into meshes at object and material changes
+    static vector<Group> groupFaces(const vector<Chunk>& chunks)
+    {
+        vector<Group> groups(1);
+        for (size_t c = 0; c < chunks.size(); c++)
+        {
+            const Chunk& chunk = chunks[c];
+            size_t first = 0;
+            for (size_t e = 0; e <= chunk.events.size(); e++)
+            {
+                size_t face = e < chunk.events.size() ? chunk.events[e].face : chunk.faceStarts.size();
+                if (face > first)
+                {
+                    FaceRange range = { c, first, face };
+                    groups.back().ranges.push_back(range);
+                    first = face;
+                }
+                if (e == chunk.events.size())
+                    break;
+
+                const Event& event = chunk.events[e];
+                if (event.material && event.name == groups.back().material)
+                    continue;
+                string material = event.material ? event.name : groups.back().material;
+                if (!groups.back().ranges.empty())
+                    groups.push_back(Group());
+                groups.back().material = material;
+            }
+        }
+        return groups;
+    }
+
+    static bool resolve(const RawCorner& raw, const Chunk& chunk, const Pools& pools, Corner& out)
+    {
+        out.v = raw.relative & 1 ? static_cast<int>(chunk.positionBase) + raw.v : raw.v - 1;
+        out.t = raw.relative & 2 ? static_cast<int>(chunk.texcoordBase) + raw.t : raw.t - 1;
+        out.n = raw.relative & 4 ? static_cast<int>(chunk.normalBase) + raw.n : raw.n - 1;
+        if (out.t >= static_cast<int>(pools.texcoords.size()))
+            out.t = -1;
+        if (out.n >= static_cast<int>(pools.normals.size()))
+            out.n = -1;
+        return out.v >= 0 && out.v < static_cast<int>(pools.positions.size());
+    }
+
+    static void buildMesh(const Group& group, const vector<Chunk>& chunks, const Pools& pools,
+                          const unordered_map<string, ObjMaterial>& materials, ScratchArena& arena, MeshData& mesh)
+    {
+        // triangulate (as a fan, like a convex polygon) and resolve every corner
+        vector<Corner> corners;
+        bool textured = false;
+        for (size_t r = 0; r < group.ranges.size(); r++)
+        {
+            const FaceRange& range = group.ranges[r];
+            const Chunk& chunk = chunks[range.chunk];
+            for (size_t f = range.first; f < range.last; f++)
+            {
+                size_t begin = chunk.faceStarts[f];
+                size_t end = f + 1 < chunk.faceStarts.size() ? chunk.faceStarts[f + 1] : chunk.corners.size();
+                Corner first, previous, c;
+                if (!resolve(chunk.corners[begin], chunk, pools, first) || !resolve(chunk.corners[begin + 1], chunk, pools, previous))
+                    continue;
+                for (size_t i = begin + 2; i < end; i++)
+                {
+                    if (!resolve(chunk.corners[i], chunk, pools, c))
+                        continue;
+                    corners.push_back(first);
+                    corners.push_back(previous);
+                    corners.push_back(c);
+                    textured = textured || first.t >= 0 || previous.t >= 0 || c.t >= 0;
+                    previous = c;
+                }
+            }
+        }
+        size_t triangles = corners.size() / 3;
+
+        // face normals and bitangents in batches over the pools
+        unsigned int* positionIndices = arena.allocate<unsigned int>(corners.size());
+        unsigned int* uvIndices = arena.allocate<unsigned int>(corners.size());
+        bool needsSmoothNormals = false;
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            positionIndices[i] = static_cast<unsigned int>(corners[i].v);
+            uvIndices[i] = corners[i].t >= 0 ? static_cast<unsigned int>(corners[i].t) : FACE_FRAMES_NO_UV;
+            needsSmoothNormals = needsSmoothNormals || corners[i].n < 0;
+        }
+        float* nx = arena.allocate<float>(triangles);
+        float* ny = arena.allocate<float>(triangles);
+        float* nz = arena.allocate<float>(triangles);
+        FaceFrames::normals(pools.x.data(), pools.y.data(), pools.z.data(), positionIndices, triangles, nx, ny, nz);
+        vector<glm::vec3> faceNormals(triangles);
+        for (size_t i = 0; i < triangles; i++)
+            faceNormals[i] = glm::vec3(nx[i], ny[i], nz[i]);
+        float* bx = NULL;
+        float* by = NULL;
+        float* bz = NULL;
+        if (textured)
+        {
+            bx = arena.allocate<float>(triangles);
+            by = arena.allocate<float>(triangles);
+            bz = arena.allocate<float>(triangles);
+            // in flipped uv space, like assimp computes them
+            FaceFrames::bitangents(pools.x.data(), pools.y.data(), pools.z.data(), positionIndices, pools.u.data(), pools.v.data(),
+                                   uvIndices, -1.0f, triangles, bx, by, bz);
+        }
+
+        // smooth normals: average of the face normals around each position
+        unordered_map<int, glm::vec3> smooth;
+        if (needsSmoothNormals)
+        {
+            for (size_t i = 0; i < corners.size(); i++)
+            {
+                glm::vec3 n = faceNormals[i / 3];
+                if (n == n) // skip degenerate triangles (nan)
+                    smooth[corners[i].v] += n;
+            }
+            for (unordered_map<int, glm::vec3>::iterator it = smooth.begin(); it != smooth.end(); ++it)
+                it->second = glm::normalize(it->second);
+        }
+
+        mesh.vertices.reserve(corners.size());
+        mesh.indices.reserve(corners.size());
+        unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+        unique.reserve(corners.size());
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            const Corner& c = corners[i];
+            VertexKey key = { c.v, c.t, c.n, faceNormals[i / 3] };
+            pair<unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> slot =
+                unique.insert(make_pair(key, static_cast<unsigned int>(mesh.vertices.size())));
+            if (slot.second)
+            {
+                Vertex vertex = Vertex();
+                vertex.Position = pools.positions[c.v];
+                vertex.Normal = c.n >= 0 ? pools.normals[c.n] : smooth[c.v];
+                if (c.t >= 0)
+                    vertex.TexCoords = glm::vec2(pools.texcoords[c.t].x, 1.0f - pools.texcoords[c.t].y);
+                vertex.FaceNormal = faceNormals[i / 3];
+                if (textured)
+                    vertex.Bitangent = glm::vec3(bx[i / 3], by[i / 3], bz[i / 3]);
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(slot.first->second);
+        }
+
+        unordered_map<string, ObjMaterial>::const_iterator material = materials.find(group.material);
+        ObjMaterial fallback;
+        const ObjMaterial& m = material != materials.end() ? material->second : fallback;
+        mesh.textures = m.textures;
+        mesh.diffuse = m.diffuse;
+        mesh.diffuse_map = false; // obj materials always carry a diffuse color, assimp reports it too
+    }
+
+    // texture maps map onto the same sampler types assimp's obj importer + Model::processMesh produce
+    static void loadMaterials(const string& path, unordered_map<string, ObjMaterial>& materials)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+            return;
+        const char* p = reinterpret_cast<const char*>(file.data());
+        const char* end = p + file.size();
+        ObjMaterial* current = NULL;
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            p = skipSpace(p, lineEnd);
+
+            if (keyword(p, lineEnd, "newmtl"))
+                current = &materials[restOfLine(p + 6, lineEnd)];
+            else if (current && keyword(p, lineEnd, "Kd"))
+            {
+                p += 2;
+                current->diffuse.x = parseFloat(p, lineEnd);
+                current->diffuse.y = parseFloat(p, lineEnd);
+                current->diffuse.z = parseFloat(p, lineEnd);
+            }
+            else if (current && keyword(p, lineEnd, "map_Kd"))
+                addTexture(*current, "texture_diffuse", p + 6, lineEnd);
+            else if (current && keyword(p, lineEnd, "map_Ks"))
+                addTexture(*current, "texture_specular", p + 6, lineEnd);
+            else if (current && (keyword(p, lineEnd, "map_Bump") || keyword(p, lineEnd, "map_bump")))
+                addTexture(*current, "texture_normal", p + 8, lineEnd);
+            else if (current && keyword(p, lineEnd, "bump"))
+                addTexture(*current, "texture_normal", p + 4, lineEnd);
+            else if (current && keyword(p, lineEnd, "map_Ka"))
+                addTexture(*current, "texture_height", p + 6, lineEnd);
+
+            p = lineEnd + 1;
+        }
+
+        // keep processMesh's order: diffuse, specular, normal, height
+        static const char* order[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        for (unordered_map<string, ObjMaterial>::iterator it = materials.begin(); it != materials.end(); ++it)
+        {
+            vector<TextureRef> sorted;
+            for (int o = 0; o < 4; o++)
+                for (size_t t = 0; t < it->second.textures.size(); t++)
+                    if (it->second.textures[t].type == order[o])
+                        sorted.push_back(it->second.textures[t]);
+            it->second.textures.swap(sorted);
+        }
+    }
+
+    // the file name is the last token, options like "-bm 0.5" come before it
+    static void addTexture(ObjMaterial& material, const char* type, const char* p, const char* lineEnd)
+    {
+        string rest = restOfLine(p, lineEnd);
+        size_t space = rest.find_last_of(" \t");
+        TextureRef ref;
+        ref.type = type;
+        ref.path = space == string::npos ? rest : rest.substr(space + 1);
+        if (!ref.path.empty())
+            material.textures.push_back(ref);
+    }
+};
+#endif
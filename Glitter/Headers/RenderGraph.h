@@ -0,0 +1,336 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "TextureBuffer.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// frames a pooled texture may sit unused before it's freed, e.g. after a resize or a view switch
+const size_t RENDER_GRAPH_IDLE_FRAMES = 30;
+
+// what a render target of the graph looks like, targets with equal descriptions can share memory
+struct RenderTargetDesc {
+    int    width = 0;
+    int    height = 0;
+    GLenum format = GL_RGBA8; // sized. a depth format makes a depth buffer, see TextureBuffer::isDepthFormat
+    bool   scaled = false;    // as large as the backbuffer times the render scale, width and height are ignored
+    GLenum filter = GL_LINEAR; // GL_NEAREST for targets that don't survive being blended, e.g. encoded normals
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return width == other.width && height == other.height && format == other.format && filter == other.filter;
+    }
+};
+
+// the resource every graph has: the default framebuffer (see setBackbuffer), what the output passes write
+const unsigned int RENDER_BACKBUFFER = 0;
+
+// the frame as passes that declare the targets they read and write. execute() runs only the passes the
+// requested output depends on, and the targets are transient: each one gets memory from a pool when its
+// first pass runs and gives it back after its last reader, so targets that are never alive at the same
+// time share a texture. passes run in the order they were added, which has to be a valid order.
+class RenderGraph
+{
+public:
+    // runs a pass. its targets are attached and bound, texture() finds what it reads.
+    typedef function<void(const RenderGraph&)> Execute;
+
+    // passes run and culled, and the textures behind the targets, by the last execute()
+    struct Stats {
+        size_t run = 0;
+        size_t culled = 0;
+        size_t textures = 0;
+    };
+    Stats stats;
+
+    RenderGraph()
+    {
+        Resource backbuffer;
+        backbuffer.name = "backbuffer";
+        resources.push_back(backbuffer);
+    }
+
+    ~RenderGraph()
+    {
+        for (size_t p = 0; p < passes.size(); p++)
+            if (passes[p].FBO)
+                glDeleteFramebuffers(1, &passes[p].FBO);
+    }
+
+    unsigned int createTarget(const string& name, const RenderTargetDesc& desc)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        resources.push_back(resource);
+        return static_cast<unsigned int>(resources.size() - 1);
+    }
+
+    unsigned int addPass(const string& name, const vector<unsigned int>& reads, const vector<unsigned int>& writes, Execute execute)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.reads = reads;
+        pass.writes = writes;
+        pass.execute = execute;
+        passes.push_back(pass);
+        return static_cast<unsigned int>(passes.size() - 1);
+    }
+
+    // follow the window. scaled targets get new textures on the next execute(), the old ones are freed
+    // once they have been idle for a while.
+    void setBackbufferSize(int width, int height)
+    {
+        resources[RENDER_BACKBUFFER].desc.width = width;
+        resources[RENDER_BACKBUFFER].desc.height = height;
+    }
+
+    // the framebuffer the output passes draw into, the window's (0) unless rendering offscreen
+    void setBackbuffer(GLuint framebuffer)
+    {
+        backbufferFBO = framebuffer;
+    }
+
+    // fraction of the backbuffer's width and height the scaled targets have, see ResolutionGovernor
+    void setRenderScale(float scale)
+    {
+        this->scale = scale;
+    }
+
+    float renderScale() const
+    {
+        return scale;
+    }
+
+    // the texture behind a target during the current execute()
+    GLuint texture(unsigned int resource) const
+    {
+        const Resource& r = resources[resource];
+        return r.physical < 0 ? 0 : pool[r.physical].buffer->tex;
+    }
+
+    // the target's description with this frame's size filled in
+    const RenderTargetDesc& desc(unsigned int resource) const
+    {
+        return resources[resource].actual;
+    }
+
+    // runs output and every pass it depends on, in order, culling the rest
+    void execute(unsigned int output)
+    {
+        // walk back from the output: a pass is needed when it writes what a needed pass reads
+        vector<bool> live(passes.size(), false);
+        vector<bool> needed(resources.size(), false);
+        for (size_t p = output + 1; p-- > 0;)
+        {
+            bool used = p == output;
+            for (size_t w = 0; w < passes[p].writes.size() && !used; w++)
+                used = needed[passes[p].writes[w]];
+            if (!used)
+                continue;
+            live[p] = true;
+            for (size_t r = 0; r < passes[p].reads.size(); r++)
+                needed[passes[p].reads[r]] = true;
+        }
+
+        // a target lives from the first pass writing it to the last one reading it
+        const RenderTargetDesc& screen = resources[RENDER_BACKBUFFER].desc;
+        for (size_t r = 0; r < resources.size(); r++)
+        {
+            Resource& resource = resources[r];
+            resource.first = resource.last = -1;
+            resource.actual = resource.desc;
+            if (resource.desc.scaled)
+            {
+                resource.actual.width = max(1, static_cast<int>(screen.width * scale + 0.5f));
+                resource.actual.height = max(1, static_cast<int>(screen.height * scale + 0.5f));
+            }
+        }
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            if (!live[p])
+                continue;
+            for (size_t w = 0; w < passes[p].writes.size(); w++)
+            {
+                Resource& r = resources[passes[p].writes[w]];
+                if (r.first < 0)
+                    r.first = r.last = static_cast<int>(p);
+            }
+            for (size_t i = 0; i < passes[p].reads.size(); i++)
+                resources[passes[p].reads[i]].last = static_cast<int>(p);
+        }
+
+        stats = Stats();
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            if (!live[p])
+            {
+                stats.culled++;
+                continue;
+            }
+            for (size_t w = 0; w < passes[p].writes.size(); w++)
+            {
+                unsigned int r = passes[p].writes[w];
+                if (r != RENDER_BACKBUFFER && resources[r].first == static_cast<int>(p))
+                    resources[r].physical = acquire(resources[r].actual);
+            }
+            bind(passes[p]);
+            passes[p].execute(*this);
+            stats.run++;
+            // what was read for the last time goes back to the pool, a later target may reuse it
+            for (size_t r = 1; r < resources.size(); r++)
+                if (resources[r].last == static_cast<int>(p) && resources[r].physical >= 0)
+                {
+                    pool[resources[r].physical].busy = false;
+                    resources[r].physical = -1;
+                }
+        }
+        frame++;
+        evict();
+        stats.textures = pool.size();
+    }
+
+    void report() const
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < pool.size(); i++)
+            bytes += static_cast<size_t>(pool[i].desc.width) * pool[i].desc.height * TextureBuffer::texelSize(pool[i].desc.format);
+        cout << "render graph: " << passes.size() << " passes, " << resources.size() - 1 << " targets in "
+             << pool.size() << " textures of " << bytes / 1024 << " KB" << endl;
+    }
+
+private:
+    RenderGraph(const RenderGraph&);
+    RenderGraph& operator=(const RenderGraph&);
+
+    struct Resource {
+        string           name;
+        RenderTargetDesc desc;
+        RenderTargetDesc actual;        // desc sized for this execute()
+        int              physical = -1; // in pool, while alive
+        int              first = -1, last = -1; // passes of this execute()
+    };
+
+    struct Pass {
+        string                name;
+        vector<unsigned int>  reads, writes;
+        Execute               execute;
+        GLuint                FBO = 0;
+        vector<GLuint>        attached; // textures on its color attachments
+        GLuint                depth = 0; // and on its depth attachment
+    };
+
+    // textures the targets are assigned to, kept across frames
+    struct Physical {
+        RenderTargetDesc         desc;
+        unique_ptr<TextureBuffer> buffer;
+        bool                     busy = false;
+        size_t                   used = 0; // frame it was last acquired
+    };
+
+    vector<Resource> resources;
+    vector<Pass>     passes;
+    vector<Physical> pool;
+    float            scale = 1.0f;
+    size_t           frame = 0;
+    GLuint           backbufferFBO = 0;
+
+    int acquire(const RenderTargetDesc& desc)
+    {
+        for (size_t i = 0; i < pool.size(); i++)
+            if (!pool[i].busy && pool[i].desc == desc)
+            {
+                pool[i].busy = true;
+                pool[i].used = frame;
+                return static_cast<int>(i);
+            }
+        Physical physical;
+        physical.desc = desc;
+        physical.buffer.reset(new TextureBuffer(desc.width, desc.height, false, desc.format, desc.filter));
+        // the texture buffer binds behind the state tracker's back
+        GLState::instance().invalidate();
+        physical.busy = true;
+        physical.used = frame;
+        pool.push_back(move(physical));
+        return static_cast<int>(pool.size() - 1);
+    }
+
+    // frees the textures no target has used for a while. only between executes, when none is busy.
+    void evict()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < pool.size(); i++)
+            if (frame - pool[i].used <= RENDER_GRAPH_IDLE_FRAMES)
+                pool[kept++] = move(pool[i]);
+        if (kept == pool.size())
+            return;
+        pool.resize(kept);
+        // a new texture may get a freed name, make the passes attach again
+        for (size_t p = 0; p < passes.size(); p++)
+            passes[p].attached.clear();
+    }
+
+    // binds the pass's framebuffer with its targets attached, and a viewport as large as they are
+    void bind(Pass& pass)
+    {
+        GLState& state = GLState::instance();
+        if (pass.writes.empty())
+            return;
+        if (pass.writes[0] == RENDER_BACKBUFFER)
+        {
+            state.bindFramebuffer(backbufferFBO);
+            const RenderTargetDesc& desc = resources[RENDER_BACKBUFFER].desc;
+            glViewport(0, 0, desc.width, desc.height);
+            return;
+        }
+
+        if (!pass.FBO)
+            glGenFramebuffers(1, &pass.FBO);
+        state.bindFramebuffer(pass.FBO);
+        // color targets on consecutive attachments in the order they're written, skipping the depth
+        // buffer. any pass writing the same depth target tests against what the earlier ones left.
+        vector<GLuint> textures;
+        GLuint depth = 0;
+        for (size_t w = 0; w < pass.writes.size(); w++)
+        {
+            const Physical& physical = pool[resources[pass.writes[w]].physical];
+            if (!TextureBuffer::isDepthFormat(physical.desc.format))
+                textures.push_back(physical.buffer->tex);
+            else if (!depth)
+                depth = physical.buffer->tex;
+        }
+        // the assignment only changes with the output, most frames attach nothing
+        if (textures != pass.attached || depth != pass.depth)
+        {
+            vector<GLenum> buffers(textures.size());
+            for (size_t w = 0; w < textures.size(); w++)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(w), GL_TEXTURE_2D, textures[w], 0);
+                buffers[w] = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(w);
+            }
+            for (size_t w = textures.size(); w < pass.attached.size(); w++)
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(w), GL_TEXTURE_2D, 0, 0);
+            if (buffers.empty())
+                glDrawBuffer(GL_NONE);
+            else
+                glDrawBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                cout << "ERROR::RENDER_GRAPH:: framebuffer of pass " << pass.name << " is not complete" << endl;
+            pass.attached = textures;
+            pass.depth = depth;
+        }
+        const RenderTargetDesc& desc = resources[pass.writes[0]].actual;
+        glViewport(0, 0, desc.width, desc.height);
+    }
+};
+#endif
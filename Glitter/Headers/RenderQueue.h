@@ -0,0 +1,178 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "Material.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// issues the GL draw of a queued item. program, VAO and material are already bound.
+typedef void (*RenderIssue)(void* owner, const Shader& shader, size_t argument);
+
+// one draw submitted to the queue
+struct RenderItem {
+    uint64_t      key = 0;             // see RenderQueue::makeKey
+    const Shader* shader = NULL;
+    unsigned int  material = MATERIAL_NONE;
+    GLuint        vao = 0;
+    RenderIssue   issue = NULL;
+    void*         owner = NULL;        // passed on to issue, with argument
+    size_t        argument = 0;
+};
+
+// the draws of a frame, sorted by a 64 bit key so that consecutive draws share as much state as possible:
+//
+//   63..60 pass | 59..52 program | 51..36 material | 35..24 VAO | 23..0 depth
+//
+// the pass keeps the order the passes run in, within a pass draws are grouped by program, then material,
+// then VAO, and draws sharing all of those go front to back for early-Z. names too large for their bits
+// wrap, which only costs grouping. clear(), submit() every draw, sort() once, then execute() each pass.
+class RenderQueue
+{
+public:
+    // switches done by the last execute() calls since clear()
+    struct Stats {
+        size_t draws = 0;
+        size_t programs = 0;
+        size_t materials = 0;
+        size_t vaos = 0;
+    };
+    Stats stats;
+
+    // depth is the view-space distance of the draw's nearest point, negative clamps to 0
+    static uint64_t makeKey(unsigned int pass, GLuint program, unsigned int material, GLuint vao, float depth)
+    {
+        // non-negative floats order like their bit patterns, the top 24 bits keep exponent and 15 mantissa bits
+        if (!(depth > 0.0f))
+            depth = 0.0f;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return (static_cast<uint64_t>(pass & 0xf) << 60) | (static_cast<uint64_t>(program & 0xff) << 52) |
+               (static_cast<uint64_t>(material & 0xffff) << 36) | (static_cast<uint64_t>(vao & 0xfff) << 24) |
+               static_cast<uint64_t>(bits >> 8);
+    }
+
+    static unsigned int passOf(uint64_t key)
+    {
+        return static_cast<unsigned int>(key >> 60);
+    }
+
+    void clear()
+    {
+        items.clear();
+        order.clear();
+        keys.clear();
+        stats = Stats();
+    }
+
+    void submit(const RenderItem& item)
+    {
+        items.push_back(item);
+    }
+
+    size_t size() const
+    {
+        return items.size();
+    }
+
+    // orders the submitted draws by key: an LSD radix sort over the key bytes, skipping bytes all keys share
+    void sort()
+    {
+        size_t count = items.size();
+        order.resize(count);
+        keys.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            order[i] = static_cast<unsigned int>(i);
+            keys[i] = items[i].key;
+        }
+        swapOrder.resize(count);
+        swapKeys.resize(count);
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[257] = { 0 };
+            for (size_t i = 0; i < count; i++)
+                histogram[((keys[i] >> shift) & 0xff) + 1]++;
+            // one bucket holding everything means this byte is already in order
+            bool trivial = false;
+            for (int b = 1; b <= 256; b++)
+                if (histogram[b] == count)
+                    trivial = true;
+            if (trivial)
+                continue;
+            for (int b = 1; b <= 256; b++)
+                histogram[b] += histogram[b - 1];
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t slot = histogram[(keys[i] >> shift) & 0xff]++;
+                swapKeys[slot] = keys[i];
+                swapOrder[slot] = order[i];
+            }
+            keys.swap(swapKeys);
+            order.swap(swapOrder);
+        }
+    }
+
+    // issues the draws of one pass in key order, switching program, material and VAO only when they change.
+    // the material state is forgotten between passes, the code around them may change it.
+    void execute(unsigned int pass)
+    {
+        GLState& state = GLState::instance();
+        MaterialTable& materials = MaterialTable::instance();
+        materials.begin();
+        GLuint program = 0, vao = 0;
+        unsigned int material = MATERIAL_NONE;
+        bool bound = false;
+
+        // the pass's draws are contiguous, find where they start
+        size_t lo = 0, hi = keys.size();
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (passOf(keys[mid]) < pass)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (size_t i = lo; i < keys.size() && passOf(keys[i]) == pass; i++)
+        {
+            const RenderItem& item = items[order[i]];
+            if (!bound || item.shader->ID != program)
+            {
+                state.useProgram(item.shader->ID);
+                program = item.shader->ID;
+                material = MATERIAL_NONE;
+                stats.programs++;
+            }
+            if (item.material != MATERIAL_NONE && item.material != material)
+            {
+                materials.apply(*item.shader, item.material);
+                material = item.material;
+                stats.materials++;
+            }
+            if (!bound || item.vao != vao)
+            {
+                state.bindVertexArray(item.vao);
+                vao = item.vao;
+                stats.vaos++;
+            }
+            bound = true;
+            item.issue(item.owner, *item.shader, item.argument);
+            stats.draws++;
+        }
+    }
+
+private:
+    vector<RenderItem>   items;
+    vector<unsigned int> order;     // items by key after sort()
+    vector<uint64_t>     keys;      // their keys, in the same order
+    vector<unsigned int> swapOrder; // radix sort scratch
+    vector<uint64_t>     swapKeys;
+};
+#endif
@@ -0,0 +1,137 @@
+#ifndef RESOLUTION_GOVERNOR_H
+#define RESOLUTION_GOVERNOR_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// gpu milliseconds a frame may take, 60 hz
+const double FRAME_BUDGET_MS = 16.0;
+
+// the render scale moves in steps this large, each step gives the scaled targets new textures
+const float RESOLUTION_STEP = 1.0f / 16.0f;
+
+// measured frames between two changes of the scale, so the average catches up with the last one
+const int RESOLUTION_SETTLE_FRAMES = 15;
+
+// holds the frame to a gpu budget by trading resolution: the time between begin() and end() is measured
+// with GL_TIME_ELAPSED queries and the render scale follows it. results are read a few frames late,
+// once they are available, so measuring never stalls the pipeline.
+class ResolutionGovernor
+{
+public:
+    ResolutionGovernor(double budgetMs = FRAME_BUDGET_MS, float minScale = 0.5f, float maxScale = 1.0f)
+        : budget(budgetMs), minScale(minScale), maxScale(maxScale), current(maxScale)
+    {
+        glGenQueries(QUERIES, queries);
+        for (int i = 0; i < QUERIES; i++)
+            pending[i] = false;
+    }
+
+    ~ResolutionGovernor()
+    {
+        glDeleteQueries(QUERIES, queries);
+    }
+
+    // around the gpu work the scale pays for. a frame isn't measured while every query is in flight.
+    void begin()
+    {
+        timing = !pending[next];
+        if (timing)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void end()
+    {
+        if (!timing)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % QUERIES;
+        timing = false;
+    }
+
+    // reads the finished measurements and returns the scale for this frame
+    float update()
+    {
+        for (int i = 0; i < QUERIES; i++)
+        {
+            // oldest first, the ring's next slot is the one that was issued longest ago
+            int slot = (next + i) % QUERIES;
+            if (!pending[slot])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+            pending[slot] = false;
+            sample(elapsed / 1.0e6);
+        }
+        return current;
+    }
+
+    float scale() const
+    {
+        return current;
+    }
+
+    // moving average of the measured frames, 0 before the first one
+    double gpuMs() const
+    {
+        return average;
+    }
+
+    void report() const
+    {
+        cout << "resolution governor: scale " << current << ", " << average << " ms of " << budget
+             << " ms budget, " << changes << " changes" << endl;
+    }
+
+private:
+    ResolutionGovernor(const ResolutionGovernor&);
+    ResolutionGovernor& operator=(const ResolutionGovernor&);
+
+    static const int QUERIES = 4;
+
+    GLuint queries[QUERIES];
+    bool   pending[QUERIES];
+    int    next = 0;
+    bool   timing = false;
+
+    double budget;
+    float  minScale, maxScale;
+    float  current;
+    double average = 0.0;
+    int    settled = 0; // samples since the last change
+    size_t changes = 0;
+
+    void sample(double ms)
+    {
+        average = average == 0.0 ? ms : average * 0.9 + ms * 0.1;
+        if (++settled < RESOLUTION_SETTLE_FRAMES)
+            return;
+
+        // the cost goes with the pixel count, the square of the scale. down as far as the measurement
+        // says, up a step at a time and only with headroom, so the scale doesn't bounce at the budget.
+        float wanted = current * static_cast<float>(sqrt(budget / average));
+        float stepped = current;
+        if (average > budget)
+            stepped = floor(wanted / RESOLUTION_STEP) * RESOLUTION_STEP;
+        else if (average < budget * 0.8)
+            stepped = min(wanted, current + RESOLUTION_STEP);
+        stepped = floor(stepped / RESOLUTION_STEP + 0.5f) * RESOLUTION_STEP;
+        stepped = max(minScale, min(maxScale, stepped));
+        if (stepped != current)
+        {
+            current = stepped;
+            settled = 0;
+            changes++;
+        }
+    }
+};
+#endif
@@ -0,0 +1,324 @@
+#ifndef SCENE_RENDERER_H
+#define SCENE_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "EdgePass.h"
+#include "GBuffer.h"
+#include "GLState.h"
+#include "Material.h"
+#include "model.h"
+#include "ModelBatch.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "shader.h"
+#include "UniformBlocks.h"
+#include "VisibilityTree.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Hue {
+    glm::vec3 cool;
+    glm::vec3 warm;
+    float alpha;
+    float beta;
+};
+
+// the view modes, what renderPassFlags selects
+enum Render_View {
+    RENDER_VIEW_GOOCH,
+    RENDER_VIEW_NORMAL_EDGES,
+    RENDER_VIEW_DEPTH_EDGES,
+    RENDER_VIEW_FACE_NORMALS,
+    RENDER_VIEW_DEPTH,
+    RENDER_VIEW_DIFFUSE,
+    RENDER_VIEW_CONTROLS,
+    RENDER_VIEWS
+};
+
+// the passes that draw the scene through the render queue, in the order they run
+enum Scene_Pass {
+    SCENE_PASS_GBUFFER
+};
+
+// everything a frame is drawn with: the programs, the shared blocks, the batch and the render graph with
+// its passes. built once, then the window's frames or a batch's jobs only change the scene and camera,
+// so programs and pooled targets are reused. GL thread only.
+class SceneRenderer
+{
+public:
+    // the frame as a render graph: the scene is rasterized once into the G-buffer, outlines and
+    // shading read it in screen space, and each view mode only runs the passes it displays
+    RenderGraph graph;
+
+    // shaderDir is where the Shaders directory's files are, the context has to be current already
+    explicit SceneRenderer(const string& shaderDir)
+        : gBufferShader(program(shaderDir, "gbuffer")), ourShader(program(shaderDir, "model")),
+          edgeShader(program(shaderDir, "edges")), diffuseShader(program(shaderDir, "diffuse")),
+          quadShader(program(shaderDir, "quad")),
+          // the tiled compute version of the edges where the context has compute shaders
+          edgeComputeShader(EdgePass::computeAvailable() ? new Shader((shaderDir + "/edges.cs").c_str()) : NULL),
+          cameraBlock("Camera", CAMERA_BLOCK_BINDING), hueBlock("Hue", HUE_BLOCK_BINDING),
+          edges(edgeShader, edgeComputeShader.get())
+    {
+        // per-frame state every program reads from shared uniform blocks
+        Shader* programs[] = { &gBufferShader, &ourShader, &diffuseShader };
+        for (unsigned int i = 0; i < sizeof(programs) / sizeof(programs[0]); i++)
+        {
+            cameraBlock.attach(*programs[i]);
+            hueBlock.attach(*programs[i]);
+        }
+        // samplers on the fixed texture units and the material records, for the geometry pass
+        MaterialTable::instance().attach(gBufferShader);
+        // the screen passes read albedo and normals from the G-buffer
+        Shader* shading[] = { &ourShader, &diffuseShader };
+        for (unsigned int i = 0; i < sizeof(shading) / sizeof(shading[0]); i++)
+        {
+            shading[i]->use();
+            shading[i]->setInt("gAlbedo", 0);
+            shading[i]->setInt("gNormal", 1);
+        }
+
+        // the remaining per-frame uniforms, resolved once
+        gBufferModelMatrix = gBufferShader.uniform<glm::mat4>("model");
+        quadChannel = quadShader.uniform<int>("channel");
+        quadContent = quadShader.uniform<int>("content");
+
+        createQuad();
+        createPasses();
+    }
+
+    ~SceneRenderer()
+    {
+        glDeleteVertexArrays(1, &quadVAO);
+        glDeleteBuffers(1, &quadVBO);
+    }
+
+    // draws model from now on, batching it again when it's a different one. NULL draws nothing.
+    void setScene(Model* model)
+    {
+        if (model == scene)
+            return;
+        if (scene)
+            visibility.remove(*scene);
+        scene = model;
+        batch.clear();
+        if (scene)
+        {
+            batch.add(*scene);
+            batch.build();
+        }
+    }
+
+    Model* currentScene() const
+    {
+        return scene;
+    }
+
+    // what the controls view shows
+    void setControls(GLuint texture)
+    {
+        controls = texture;
+    }
+
+    // one frame of a view mode into the graph's backbuffer, which is width x height large. model places
+    // the scene. a view out of range draws nothing.
+    void render(int mode, const glm::mat4& model, Camera& camera, const Hue& hue, int width, int height)
+    {
+        this->model = model;
+        graph.setBackbufferSize(width, height);
+
+        // view/projection transformations
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+        glm::mat4 view = camera.GetViewMatrix();
+
+        // one upload each for all programs
+        CameraBlock cameraData = { projection, view, camera.Right, 0.0f };
+        cameraBlock.update(cameraData);
+        HueBlock hueData = { hue.cool, 0.0f, hue.warm, hue.alpha, hue.beta, { 0.0f, 0.0f, 0.0f } };
+        hueBlock.update(hueData);
+
+        // only the meshes inside the frustum are submitted to the passes below
+        if (scene)
+        {
+            visibility.place(*scene, model);
+            visibility.cull(projection * view);
+
+            // same level of detail in every pass, so the outline buffers line up with the shading
+            scene->selectLods(model, view, camera.Zoom, height * graph.renderScale());
+            scene->cullMeshlets(model, view, projection);
+        }
+        batch.update(view * model);
+
+        queue.clear();
+        batch.submit(queue, SCENE_PASS_GBUFFER, gBufferShader, BATCH_MATERIALS);
+        queue.sort();
+
+        // uploads before the frame bind behind the state tracker's back, it starts over from here
+        GLState::instance().beginFrame();
+
+        // only what the selected view displays runs
+        if (mode >= 0 && mode < RENDER_VIEWS)
+            graph.execute(views[mode]);
+    }
+
+    // the program of Shaders/<name>.vs and .fs
+    static Shader program(const string& shaderDir, const string& name)
+    {
+        string vertexShader = shaderDir + "/" + name + ".vs";
+        string fragShader = shaderDir + "/" + name + ".fs";
+        return Shader(vertexShader.c_str(), fragShader.c_str());
+    }
+
+private:
+    Shader gBufferShader;
+    Shader ourShader;
+    Shader edgeShader;
+    Shader diffuseShader;
+    Shader quadShader;
+    unique_ptr<Shader> edgeComputeShader;
+
+    UniformBlock<CameraBlock> cameraBlock;
+    UniformBlock<HueBlock> hueBlock;
+    Uniform<glm::mat4> gBufferModelMatrix;
+    Uniform<int> quadChannel;
+    Uniform<int> quadContent;
+
+    EdgePass edges;
+
+    // world-space boxes of every mesh in the scene, queried against the frustum each frame
+    VisibilityTree visibility;
+    // every mesh in shared buffers, each pass below is a multi-draw per material at most
+    ModelBatch batch;
+    // the scene draws of every pass, sorted each frame to switch as little state as possible
+    RenderQueue queue;
+
+    Model*       scene = NULL;
+    glm::mat4    model = glm::mat4(1.0f); // of the scene, for the geometry pass
+    GLuint       controls = 0;
+    unsigned int quadVAO = 0, quadVBO = 0;
+    unsigned int views[RENDER_VIEWS];
+
+    SceneRenderer(const SceneRenderer&);
+    SceneRenderer& operator=(const SceneRenderer&);
+
+    void createQuad()
+    {
+        float quadVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
+            // positions   // texCoords
+            -1.0f,  1.0f,  0.0f, 1.0f,
+            -1.0f, -1.0f,  0.0f, 0.0f,
+             1.0f, -1.0f,  1.0f, 0.0f,
+
+            -1.0f,  1.0f,  0.0f, 1.0f,
+             1.0f, -1.0f,  1.0f, 0.0f,
+             1.0f,  1.0f,  1.0f, 1.0f
+        };
+
+        // screen quad VAO
+        glGenVertexArrays(1, &quadVAO);
+        glGenBuffers(1, &quadVBO);
+        glBindVertexArray(quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+        glBindVertexArray(0);
+    }
+
+    // the scene and outline targets follow the backbuffer times the render scale, the views upscale them.
+    // the G-buffer is point sampled (see GBUFFER_FILTER), only the outline masks are smoothed on the way up.
+    void createPasses()
+    {
+        unsigned int gBuffer[GBUFFER_TARGETS];
+        static const char* gBufferNames[GBUFFER_TARGETS] = { "face normals", "albedo", "normals", "depth" };
+        for (int i = 0; i < GBUFFER_TARGETS; i++)
+        {
+            RenderTargetDesc desc;
+            desc.scaled = true;
+            desc.format = GBUFFER_FORMATS[i];
+            desc.filter = GBUFFER_FILTER;
+            gBuffer[i] = graph.createTarget(gBufferNames[i], desc);
+        }
+        // both outline masks in one target, see EdgePass
+        RenderTargetDesc edgeDesc;
+        edgeDesc.scaled = true;
+        edgeDesc.format = GL_RG8;
+        unsigned int edgeMask = graph.createTarget("edges", edgeDesc);
+
+        // rasterize face normals, albedo and normals in one go, and the depth buffer the depth edges read
+        graph.addPass("geometry", vector<unsigned int>(), vector<unsigned int>(gBuffer, gBuffer + GBUFFER_TARGETS),
+            [this](const RenderGraph&) {
+                GLState::instance().setDepthTest(true);
+                clearGBuffer();
+                gBufferShader.use();
+                gBufferShader.set(gBufferModelMatrix, model);
+                queue.execute(SCENE_PASS_GBUFFER);
+            });
+
+        // process depth and normal for outlines, both in one pass
+        unsigned int faceNormals = gBuffer[GBUFFER_FACE_NORMAL], depth = gBuffer[GBUFFER_DEPTH];
+        graph.addPass("edges", { faceNormals, depth }, { edgeMask },
+            [this, faceNormals, depth, edgeMask](const RenderGraph& g) {
+                edges.run(g.texture(faceNormals), g.texture(depth), g.texture(edgeMask),
+                          g.desc(edgeMask).width, g.desc(edgeMask).height, quadVAO);
+            });
+
+        // render to main frame, one output pass per view mode
+        unsigned int albedo = gBuffer[GBUFFER_ALBEDO], normals = gBuffer[GBUFFER_NORMAL];
+        vector<unsigned int> backbuffer(1, RENDER_BACKBUFFER);
+        vector<unsigned int> shaded = { albedo, normals };
+        views[RENDER_VIEW_GOOCH] = graph.addPass("gooch", shaded, backbuffer,
+            [this, albedo, normals](const RenderGraph& g) { shade(ourShader, g.texture(albedo), g.texture(normals)); });
+        views[RENDER_VIEW_NORMAL_EDGES] = graph.addPass("normal edges", { edgeMask }, backbuffer,
+            [this, edgeMask](const RenderGraph& g) { show(g.texture(edgeMask), 0, 0); });
+        views[RENDER_VIEW_DEPTH_EDGES] = graph.addPass("depth edges", { edgeMask }, backbuffer,
+            [this, edgeMask](const RenderGraph& g) { show(g.texture(edgeMask), 1, 0); });
+        views[RENDER_VIEW_FACE_NORMALS] = graph.addPass("face normals", { faceNormals }, backbuffer,
+            [this, faceNormals](const RenderGraph& g) { show(g.texture(faceNormals), -1, 1); });
+        views[RENDER_VIEW_DEPTH] = graph.addPass("depth", { depth }, backbuffer,
+            [this, depth](const RenderGraph& g) { show(g.texture(depth), -1, 2); });
+        views[RENDER_VIEW_DIFFUSE] = graph.addPass("diffuse", shaded, backbuffer,
+            [this, albedo, normals](const RenderGraph& g) { shade(diffuseShader, g.texture(albedo), g.texture(normals)); });
+        views[RENDER_VIEW_CONTROLS] = graph.addPass("controls", vector<unsigned int>(), backbuffer,
+            [this](const RenderGraph&) { show(controls, -1, 0); });
+    }
+
+    // a full-screen quad with texture on unit 0
+    void present(const Shader& shader, GLuint texture)
+    {
+        GLState& state = GLState::instance();
+        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        state.setDepthTest(false);
+        shader.use();
+        state.bindTexture(0, texture);
+        state.bindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    // a texture as is, or one of its channels as grey. content is what quad.fs decodes it as.
+    void show(GLuint texture, int channel, int content)
+    {
+        quadShader.use();
+        quadShader.set(quadChannel, channel);
+        quadShader.set(quadContent, content);
+        present(quadShader, texture);
+    }
+
+    // gooch and diffuse shading of the G-buffer, light direction and hue come from the shared blocks
+    void shade(const Shader& shader, GLuint albedo, GLuint normals)
+    {
+        GLState::instance().bindTexture(1, normals);
+        present(shader, albedo);
+    }
+};
+#endif
@@ -0,0 +1,112 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// bump allocator for the temporaries of an import. nothing is freed one by one, reset() drops every
+// allocation at once and keeps the memory for the next mesh. only for trivially copyable types, the
+// memory isn't initialized.
+class ScratchArena
+{
+public:
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        static_assert(is_trivially_copyable<T>::value, "scratch memory is never constructed or destroyed");
+        size_t bytes = (count * sizeof(T) + 15) & ~static_cast<size_t>(15);
+        if (blocks.empty() || used + bytes > blocks.back().size)
+        {
+            Block block;
+            block.size = max(bytes, blocks.empty() ? static_cast<size_t>(1 << 20) : blocks.back().size * 2);
+            block.data.reset(new unsigned char[block.size + 15]);
+            blocks.push_back(move(block));
+            used = 0;
+        }
+        unsigned char* base = blocks.back().data.get();
+        base += (16 - reinterpret_cast<size_t>(base) % 16) % 16;
+        T* result = reinterpret_cast<T*>(base + used);
+        used += bytes;
+        return result;
+    }
+
+    // forgets every allocation. a run that needed several blocks leaves one block as large as all of
+    // them together, so the next mesh of similar size allocates nothing.
+    void reset()
+    {
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < blocks.size(); i++)
+                total += blocks[i].size;
+            blocks.clear();
+            Block block;
+            block.size = total;
+            block.data.reset(new unsigned char[total + 15]);
+            blocks.push_back(move(block));
+        }
+        used = 0;
+    }
+
+private:
+    struct Block {
+        unique_ptr<unsigned char[]> data;
+        size_t size = 0;
+    };
+    vector<Block> blocks;
+    size_t used = 0; // of the last block
+};
+
+// the arenas of one import. every job borrows one for as long as it runs, so there are never more
+// arenas than threads working on the import, and they all go away with it.
+class ScratchArenas
+{
+public:
+    // a reset arena, returned when the lease goes out of scope
+    class Lease
+    {
+    public:
+        Lease(ScratchArenas& owner) : owner(owner), arena(owner.acquire()) {}
+        ~Lease() { owner.release(arena); }
+        ScratchArena& operator*() const { return *arena; }
+        ScratchArena* operator->() const { return arena; }
+
+    private:
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+        ScratchArenas& owner;
+        ScratchArena* arena;
+    };
+
+private:
+    mutex lock;
+    vector<unique_ptr<ScratchArena>> arenas;
+    vector<ScratchArena*> idle;
+
+    ScratchArena* acquire()
+    {
+        lock_guard<mutex> guard(lock);
+        if (idle.empty())
+        {
+            arenas.push_back(unique_ptr<ScratchArena>(new ScratchArena()));
+            return arenas.back().get();
+        }
+        ScratchArena* arena = idle.back();
+        idle.pop_back();
+        return arena;
+    }
+
+    void release(ScratchArena* arena)
+    {
+        arena->reset();
+        lock_guard<mutex> guard(lock);
+        idle.push_back(arena);
+    }
+};
+#endif
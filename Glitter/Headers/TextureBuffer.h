@@ -1,3 +1,6 @@
+#ifndef TEXTURE_BUFFER_H
+#define TEXTURE_BUFFER_H
+
 #include <glad/glad.h>
 
 class TextureBuffer {
@@ -7,9 +10,14 @@ public:
 	unsigned int tex;
 	unsigned int depthrenderbuffer;
 	bool hasDepth = false;
+	int width, height;
 
 	//constructor
-	TextureBuffer(int width, int height, bool depthBuffer) {
+	// internalFormat must be sized (GL_RGBA8) for targets compute shaders write as images. compact ones
+	// (GL_R8, GL_RG16, GL_R16F, GL_R32F...) hold as much as a target needs, a depth format makes tex a
+	// depth texture on the depth attachment that later passes can sample. filter is GL_NEAREST for targets
+	// whose texels mustn't be blended when they're sampled at another size.
+	TextureBuffer(int width, int height, bool depthBuffer, GLenum internalFormat = GL_RGB, GLenum filter = GL_LINEAR) : width(width), height(height) {
 
 		hasDepth = depthBuffer;
 		depthrenderbuffer = 0; // compiler complains unless I do this
@@ -18,14 +26,21 @@ public:
 
 		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 		glBindTexture(GL_TEXTURE_2D, tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		bool depthTexture = isDepthFormat(internalFormat);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, pixelFormat(internalFormat),
+			depthTexture ? GL_FLOAT : GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+		if (depthTexture) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex, 0);
+			glDrawBuffer(GL_NONE);
+		}
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
 
-		if (depthBuffer) {
+		if (depthBuffer && !depthTexture) {
 			glGenRenderbuffers(1, &depthrenderbuffer);
 			glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
 			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
@@ -34,4 +49,43 @@ public:
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
+
+	~TextureBuffer() {
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteTextures(1, &tex);
+		if (depthrenderbuffer)
+			glDeleteRenderbuffers(1, &depthrenderbuffer);
+	}
+
+	static bool isDepthFormat(GLenum internalFormat) {
+		return internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+			internalFormat == GL_DEPTH_COMPONENT32F || internalFormat == GL_DEPTH_COMPONENT;
+	}
+
+	// bytes a texel of the format takes, before whatever padding the driver adds
+	static int texelSize(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGB: case GL_RGB8: return 3;
+		case GL_RGBA16F: case GL_RG32F: return 8;
+		default: return 4;
+		}
+	}
+
+private:
+	// owns its GL objects, see RenderGraph for where they live
+	TextureBuffer(const TextureBuffer&);
+	TextureBuffer& operator=(const TextureBuffer&);
+
+	// the unsized format of the internal one, what glTexImage2D wants alongside it
+	static GLenum pixelFormat(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_R8: case GL_R16: case GL_R16F: case GL_R32F: return GL_RED;
+		case GL_RG8: case GL_RG16: case GL_RG16F: case GL_RG32F: return GL_RG;
+		case GL_RGBA: case GL_RGBA8: case GL_RGBA16F: return GL_RGBA;
+		default: return isDepthFormat(internalFormat) ? GL_DEPTH_COMPONENT : GL_RGB;
+		}
+	}
 };
+#endif
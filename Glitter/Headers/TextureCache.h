@@ -0,0 +1,158 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// a GL texture owned by the cache. shared between every user of the same file, the texture is
+// deleted when the last handle goes away.
+class TextureHandle
+{
+public:
+    unsigned int id;
+    std::string  key;
+
+    TextureHandle(unsigned int id, const std::string& key) : id(id), key(key) {}
+    ~TextureHandle();
+
+private:
+    TextureHandle(const TextureHandle&);
+    TextureHandle& operator=(const TextureHandle&);
+};
+
+struct TextureCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t resident = 0;      // textures currently alive
+    size_t residentBytes = 0; // estimated, counted once a texture has finished uploading
+};
+
+// process-wide texture registry. lookups are hashed on the canonicalized path plus the load options,
+// so every model asking for the same image gets the same GL texture. GL thread only.
+class TextureCache
+{
+public:
+    static TextureCache& instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<TextureHandle> acquire(const std::string& filename, bool gamma = false, bool normalMap = false)
+    {
+        std::string key = canonicalPath(filename) + (gamma ? "|srgb" : "|linear") + (normalMap ? "|normal" : "");
+
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it != entries.end())
+        {
+            std::shared_ptr<TextureHandle> handle = it->second.handle.lock();
+            if (handle)
+            {
+                stats.hits++;
+                return handle;
+            }
+        }
+
+        stats.misses++;
+        stats.resident++;
+        unsigned int id = TextureStreamer::instance().load(filename, normalMap, [key](size_t bytes) {
+            TextureCache::instance().uploaded(key, bytes);
+        }, gamma);
+        std::shared_ptr<TextureHandle> handle(new TextureHandle(id, key));
+        Entry& entry = entries[key];
+        entry.handle = handle;
+        entry.bytes = 0;
+        return handle;
+    }
+
+    const TextureCacheStats& statistics() const { return stats; }
+
+    void report() const
+    {
+        std::cout << "texture cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.resident << " resident (" << stats.residentBytes / 1024 << " KiB)" << std::endl;
+    }
+
+    // after this, dying handles no longer delete their textures. call right before the context is
+    // destroyed, the driver frees whatever is left along with it.
+    void shutdown()
+    {
+        alive = false;
+    }
+
+    // called by ~TextureHandle
+    void release(const TextureHandle& handle)
+    {
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(handle.key);
+        if (it != entries.end())
+        {
+            stats.residentBytes -= it->second.bytes;
+            entries.erase(it);
+        }
+        stats.resident--;
+        if (!alive)
+            return;
+        TextureStreamer::instance().cancel(handle.id);
+        glDeleteTextures(1, &handle.id);
+    }
+
+    // absolute path with normalized separators, lower case on windows where the file system ignores case
+    static std::string canonicalPath(const std::string& path)
+    {
+        std::string result = path;
+#ifdef _WIN32
+        char buffer[_MAX_PATH];
+        if (_fullpath(buffer, path.c_str(), _MAX_PATH))
+            result = buffer;
+        std::replace(result.begin(), result.end(), '\\', '/');
+        std::transform(result.begin(), result.end(), result.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+#else
+        char* resolved = realpath(path.c_str(), NULL);
+        if (resolved)
+        {
+            result = resolved;
+            free(resolved);
+        }
+#endif
+        return result;
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<TextureHandle> handle;
+        size_t bytes = 0;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    TextureCacheStats stats;
+    bool alive = true;
+
+    TextureCache() {}
+
+    void uploaded(const std::string& key, size_t bytes)
+    {
+        std::unordered_map<std::string, Entry>::iterator it = entries.find(key);
+        if (it == entries.end())
+            return;
+        it->second.bytes = bytes;
+        stats.residentBytes += bytes;
+    }
+
+    TextureCache(const TextureCache&);
+    TextureCache& operator=(const TextureCache&);
+};
+
+inline TextureHandle::~TextureHandle()
+{
+    TextureCache::instance().release(*this);
+}
+#endif
@@ -0,0 +1,397 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <stb_dxt.h>
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// block compressed formats, in case the loader header doesn't carry the s3tc extension
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+
+// bump whenever the encoder output changes, older .ktx files are then rebuilt
+const int TEXTURE_COMPRESSOR_VERSION = 1;
+
+struct CompressedLevel {
+    int    width;
+    int    height;
+    size_t offset; // into CompressedImage::data
+    size_t size;
+};
+
+// a block compressed texture with its full mip chain, level 0 first
+struct CompressedImage {
+    GLenum internalFormat = 0;
+    GLenum baseFormat = 0;
+    int    blockBytes = 0;
+    std::vector<CompressedLevel> levels;
+    std::vector<unsigned char>   data;
+
+    bool valid() const { return !levels.empty(); }
+};
+
+// encodes images to BC1 (opaque color), BC3 (color + alpha), BC4 (single channel) or BC5 (normal maps)
+// with a precomputed box filtered mip chain, and caches the result as "<source>.ktx" (KTX 1.1) next to
+// the source image. a cache is reused as long as it is newer than the source and was written with the
+// same options.
+class TextureCompressor
+{
+public:
+    // worker thread entry: reads a fresh cache, or decodes, compresses and writes one
+    static bool loadOrCompress(const std::string& filename, bool normalMap, bool flipped, CompressedImage& image)
+    {
+        std::string ktxPath = cachePath(filename);
+        std::string options = optionString(normalMap, flipped);
+        if (isFresh(filename, ktxPath) && readKtx(ktxPath, options, image))
+            return true;
+
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+        if (!pixels)
+            return false;
+        compress(pixels, width, height, channels, normalMap, image);
+        stbi_image_free(pixels);
+
+        // a read-only asset directory just means we compress again next time
+        writeKtx(ktxPath, options, image);
+        return true;
+    }
+
+    // offline bake, used by the --compress-textures command line mode
+    static bool compressFile(const std::string& filename, bool normalMap, bool flipped)
+    {
+        CompressedImage image;
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+        if (!pixels)
+            return false;
+        compress(pixels, width, height, channels, normalMap, image);
+        stbi_image_free(pixels);
+        return writeKtx(cachePath(filename), optionString(normalMap, flipped), image);
+    }
+
+    static std::string cachePath(const std::string& filename)
+    {
+        return filename + ".ktx";
+    }
+
+    static void compress(const unsigned char* pixels, int width, int height, int channels, bool normalMap, CompressedImage& image)
+    {
+        // expand to rgba once, the mip filter and the block fetch then only deal with one layout
+        std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+        bool opaque = true;
+        for (size_t i = 0, n = static_cast<size_t>(width) * height; i < n; i++)
+        {
+            const unsigned char* src = pixels + i * channels;
+            unsigned char* dst = &rgba[i * 4];
+            dst[0] = src[0];
+            dst[1] = channels >= 3 ? src[1] : src[0];
+            dst[2] = channels >= 3 ? src[2] : src[0];
+            dst[3] = channels == 2 ? src[1] : channels == 4 ? src[3] : 255;
+            opaque = opaque && dst[3] == 255;
+        }
+
+        if (normalMap)
+            setFormat(image, GL_COMPRESSED_RG_RGTC2, GL_RG, 16);
+        else if (channels == 1)
+            setFormat(image, GL_COMPRESSED_RED_RGTC1, GL_RED, 8);
+        else if (!opaque)
+            setFormat(image, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA, 16);
+        else
+            setFormat(image, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_RGB, 8);
+
+        image.levels.clear();
+        image.data.clear();
+        int w = width, h = height;
+        for (;;)
+        {
+            encodeLevel(rgba, w, h, image);
+            if (w == 1 && h == 1)
+                break;
+            rgba = downsample(rgba, w, h);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    }
+
+    // levels in a full chain down to 1x1
+    static uint32_t mipLevels(uint32_t width, uint32_t height)
+    {
+        uint32_t levels = 1;
+        while ((width | height) >> levels)
+            levels++;
+        return levels;
+    }
+
+    static size_t levelSize(int width, int height, int blockBytes)
+    {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+
+    static bool readKtx(const std::string& path, const std::string& options, CompressedImage& image)
+    {
+        MappedFile mapped(path);
+        if (!mapped.isOpen())
+            return false;
+        const unsigned char* file = mapped.data();
+        size_t fileSize = mapped.size();
+
+        KtxHeader header;
+        if (fileSize < sizeof(header))
+            return false;
+        memcpy(&header, file, sizeof(header));
+        if (memcmp(header.identifier, ktxIdentifier(), 12) != 0 || header.endianness != 0x04030201
+            || header.glType != 0 || header.pixelDepth != 0 || header.numberOfFaces != 1
+            || header.pixelWidth == 0 || header.pixelHeight == 0
+            || header.numberOfMipmapLevels != mipLevels(header.pixelWidth, header.pixelHeight))
+            return false;
+
+        size_t offset = sizeof(header);
+        if (fileSize - offset < header.bytesOfKeyValueData)
+            return false;
+        std::string stored = findKeyValue(file + offset, header.bytesOfKeyValueData, "GlitterOptions");
+        if (stored != options)
+            return false;
+        offset += header.bytesOfKeyValueData;
+
+        int blockBytes = (header.glInternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.glInternalFormat == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+        setFormat(image, header.glInternalFormat, header.glBaseInternalFormat, blockBytes);
+        image.levels.clear();
+        image.data.clear();
+        int w = static_cast<int>(header.pixelWidth), h = static_cast<int>(header.pixelHeight);
+        for (uint32_t level = 0; level < header.numberOfMipmapLevels; level++)
+        {
+            uint32_t size;
+            if (fileSize - offset < sizeof(size))
+                return false;
+            memcpy(&size, file + offset, sizeof(size));
+            offset += sizeof(size);
+            if (size != levelSize(w, h, blockBytes) || fileSize - offset < size)
+                return false;
+            CompressedLevel l = { w, h, image.data.size(), size };
+            image.data.insert(image.data.end(), file + offset, file + offset + size);
+            image.levels.push_back(l);
+            offset += (size + 3) & ~3u;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        return true;
+    }
+
+    static bool writeKtx(const std::string& path, const std::string& options, const CompressedImage& image)
+    {
+        if (!image.valid())
+            return false;
+
+        // key/value block: uint32 size, "key\0value\0", padded to 4 bytes
+        std::string kv = std::string("GlitterOptions") + '\0' + options + '\0';
+        uint32_t kvSize = static_cast<uint32_t>(kv.size());
+        while (kv.size() % 4)
+            kv += '\0';
+
+        KtxHeader header;
+        memcpy(header.identifier, ktxIdentifier(), 12);
+        header.endianness = 0x04030201;
+        header.glType = 0;
+        header.glTypeSize = 1;
+        header.glFormat = 0;
+        header.glInternalFormat = image.internalFormat;
+        header.glBaseInternalFormat = image.baseFormat;
+        header.pixelWidth = image.levels[0].width;
+        header.pixelHeight = image.levels[0].height;
+        header.pixelDepth = 0;
+        header.numberOfArrayElements = 0;
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = static_cast<uint32_t>(image.levels.size());
+        header.bytesOfKeyValueData = static_cast<uint32_t>(sizeof(uint32_t) + kv.size());
+
+        std::string tmpPath = path + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+            && fwrite(&kvSize, sizeof(kvSize), 1, out) == 1
+            && fwrite(kv.data(), 1, kv.size(), out) == kv.size();
+        for (size_t i = 0; ok && i < image.levels.size(); i++)
+        {
+            // block sizes are multiples of 8, so no mip padding is ever needed
+            uint32_t size = static_cast<uint32_t>(image.levels[i].size);
+            ok = fwrite(&size, sizeof(size), 1, out) == 1
+                && fwrite(&image.data[image.levels[i].offset], 1, size, out) == size;
+        }
+        ok = (fclose(out) == 0) && ok;
+        if (!ok)
+        {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        remove(path.c_str());
+        return rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct KtxHeader {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    static const unsigned char* ktxIdentifier()
+    {
+        static const unsigned char id[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return id;
+    }
+
+    static std::string optionString(bool normalMap, bool flipped)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "v%d normal=%d flip=%d", TEXTURE_COMPRESSOR_VERSION, normalMap ? 1 : 0, flipped ? 1 : 0);
+        return buffer;
+    }
+
+    static bool isFresh(const std::string& source, const std::string& cache)
+    {
+        struct stat src, dst;
+        if (stat(source.c_str(), &src) != 0 || stat(cache.c_str(), &dst) != 0)
+            return false;
+        return dst.st_mtime >= src.st_mtime;
+    }
+
+    static std::string findKeyValue(const unsigned char* data, size_t size, const std::string& key)
+    {
+        size_t offset = 0;
+        while (size - offset >= 4)
+        {
+            uint32_t pairSize;
+            memcpy(&pairSize, data + offset, 4);
+            offset += 4;
+            if (size - offset < pairSize)
+                break;
+            const char* pair = reinterpret_cast<const char*>(data + offset);
+            const void* terminator = memchr(pair, 0, pairSize);
+            size_t keyLength = terminator ? static_cast<const char*>(terminator) - pair : pairSize;
+            if (keyLength < pairSize && key == std::string(pair, keyLength))
+            {
+                std::string value(pair + keyLength + 1, pairSize - keyLength - 1);
+                return value.substr(0, value.find('\0'));
+            }
+            offset += (pairSize + 3) & ~3u;
+        }
+        return "";
+    }
+
+    static void setFormat(CompressedImage& image, GLenum internalFormat, GLenum baseFormat, int blockBytes)
+    {
+        image.internalFormat = internalFormat;
+        image.baseFormat = baseFormat;
+        image.blockBytes = blockBytes;
+    }
+
+    static void encodeLevel(const std::vector<unsigned char>& rgba, int width, int height, CompressedImage& image)
+    {
+        CompressedLevel level = { width, height, image.data.size(), levelSize(width, height, image.blockBytes) };
+        image.data.resize(image.data.size() + level.size);
+        unsigned char* dst = &image.data[level.offset];
+
+        unsigned char block[64];
+        unsigned char channels[32];
+        for (int by = 0; by < height; by += 4)
+        {
+            for (int bx = 0; bx < width; bx += 4)
+            {
+                // edge blocks repeat the last row/column
+                for (int y = 0; y < 4; y++)
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+                        memcpy(block + (y * 4 + x) * 4, &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+                    }
+
+                switch (image.internalFormat)
+                {
+                case GL_COMPRESSED_RG_RGTC2:
+                    for (int i = 0; i < 16; i++)
+                    {
+                        channels[i * 2] = block[i * 4];
+                        channels[i * 2 + 1] = block[i * 4 + 1];
+                    }
+                    stb_compress_bc5_block(dst, channels);
+                    break;
+                case GL_COMPRESSED_RED_RGTC1:
+                    for (int i = 0; i < 16; i++)
+                        channels[i] = block[i * 4];
+                    stb_compress_bc4_block(dst, channels);
+                    break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                    stb_compress_dxt_block(dst, block, 1, STB_DXT_NORMAL);
+                    break;
+                default:
+                    stb_compress_dxt_block(dst, block, 0, STB_DXT_NORMAL);
+                    break;
+                }
+                dst += image.blockBytes;
+            }
+        }
+        image.levels.push_back(level);
+    }
+
+    // 2x2 box filter, odd edges reuse the last texel
+    static std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height)
+    {
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        std::vector<unsigned char> result(static_cast<size_t>(w) * h * 4);
+        for (int y = 0; y < h; y++)
+        {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                            + rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c] + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                    result[(static_cast<size_t>(y) * w + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,440 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "ThreadPool.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// bytes of pixel data uploaded per frame, and the size of each pixel buffer in the upload ring
+const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;
+const unsigned int TEXTURE_UPLOAD_RING = 3;
+
+// asynchronous texture loading.
+//
+// load() hands out a texture name right away. images are decoded on the thread pool, and update(),
+// called once per frame on the GL thread, copies decoded rows into a ring of pixel buffer objects and
+// from there into the texture, at most TEXTURE_UPLOAD_BUDGET bytes per frame.
+//
+// until an image is complete the texture samples a 1x1 white placeholder: the placeholder lives in
+// the smallest mip level and GL_TEXTURE_BASE_LEVEL points at it while level 0 is being filled in.
+//
+// when the driver supports s3tc, workers load (or build) the block compressed .ktx cache of each image
+// instead, see TextureCompressor. compressed mips are uploaded smallest first and GL_TEXTURE_BASE_LEVEL
+// follows the last complete level, so textures sharpen progressively while they stream in.
+class TextureStreamer
+{
+public:
+    static TextureStreamer& instance()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    // called on the GL thread once a texture is complete, with the bytes its mip chain occupies
+    typedef std::function<void(size_t bytes)> Callback;
+
+    // use block compressed textures when the driver supports them, on by default
+    bool compression = true;
+
+    // mirrors stbi_set_flip_vertically_on_load, the flag is part of the compressed cache key
+    void setFlipVertically(bool flip)
+    {
+        flipVertically = flip;
+        stbi_set_flip_vertically_on_load(flip);
+    }
+
+    // creates the texture with its placeholder and queues the decode. normal maps compress to two
+    // channel BC5, so they must be marked. srgb images (color maps with gamma correction) are sampled
+    // as linear values, only rgb and rgba ones though, there's no core sRGB format with fewer channels.
+    // GL thread only.
+    unsigned int load(const std::string& filename, bool normalMap = false, Callback onComplete = Callback(), bool srgb = false)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        std::shared_ptr<Job> job(new Job());
+        job->texture = textureID;
+        job->filename = filename;
+        job->onComplete = onComplete;
+        job->compress = compression && compressionSupported(srgb);
+        job->normalMap = normalMap;
+        job->srgb = srgb;
+        job->flipped = flipVertically;
+        jobs[textureID] = job;
+
+        std::shared_ptr<Queue> q = queue;
+        {
+            std::lock_guard<std::mutex> lock(q->mutex);
+            q->decoding++;
+        }
+        ThreadPool::shared().enqueue([q, job]() {
+            if (!job->compress || !TextureCompressor::loadOrCompress(job->filename, job->normalMap, job->flipped, job->compressed))
+                job->pixels = stbi_load(job->filename.c_str(), &job->width, &job->height, &job->channels, 0);
+            std::lock_guard<std::mutex> lock(q->mutex);
+            q->decoding--;
+            q->decoded.push_back(job);
+        });
+        return textureID;
+    }
+
+    // uploads decoded images, at most budget bytes this call. GL thread only, once per frame.
+    void update(size_t budget = TEXTURE_UPLOAD_BUDGET)
+    {
+        GLint previousAlignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        while (budget > 0)
+        {
+            if (!current && !nextJob())
+                break;
+            if (current->canceled)
+            {
+                current.reset();
+                continue;
+            }
+            if (current->compressed.valid())
+            {
+                budget -= std::min(budget, uploadBlocks(*current, budget));
+                if (current->level < 0)
+                {
+                    finish(*current);
+                    current.reset();
+                }
+                continue;
+            }
+            if (!current->pixels)
+            {
+                std::cout << "Texture failed to load at path: " << current->filename << std::endl;
+                jobs.erase(current->texture);
+                current.reset();
+                continue;
+            }
+            if (current->rowsUploaded == 0)
+                allocate(*current);
+            budget -= std::min(budget, uploadRows(*current, budget));
+            if (current->rowsUploaded == current->height)
+            {
+                finish(*current);
+                current.reset();
+            }
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+    }
+
+    // blocks until every queued texture is decoded and uploaded
+    void flush()
+    {
+        while (pending())
+        {
+            update(static_cast<size_t>(-1));
+            std::this_thread::yield();
+        }
+    }
+
+    // true while anything is still decoding or waiting for upload
+    bool pending()
+    {
+        if (current)
+            return true;
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        return queue->decoding > 0 || !queue->decoded.empty();
+    }
+
+    // drops a pending load. must be called before deleting a texture that may still be streaming,
+    // otherwise the upload would go to a dead (or recycled) texture name.
+    void cancel(unsigned int texture)
+    {
+        std::map<unsigned int, std::shared_ptr<Job> >::iterator it = jobs.find(texture);
+        if (it == jobs.end())
+            return;
+        it->second->canceled = true;
+        jobs.erase(it);
+    }
+
+    // frees the upload ring, call before the context goes away
+    void release()
+    {
+        if (ring[0])
+            glDeleteBuffers(TEXTURE_UPLOAD_RING, ring);
+        for (unsigned int i = 0; i < TEXTURE_UPLOAD_RING; i++)
+            ring[i] = 0;
+    }
+
+private:
+    struct Job {
+        unsigned int   texture = 0;
+        std::string    filename;
+        unsigned char* pixels = NULL;
+        int            width = 0;
+        int            height = 0;
+        int            channels = 0;
+        int            rowsUploaded = 0;   // pixel rows, or block rows of the current level when compressed
+        bool           compress = false;
+        bool           normalMap = false;
+        bool           flipped = false;
+        bool           srgb = false;
+        CompressedImage compressed;
+        int            level = INT_MAX;    // compressed level being uploaded, counts down to 0
+        bool           canceled = false; // only touched on the GL thread
+        Callback       onComplete;
+        ~Job() { stbi_image_free(pixels); }
+    };
+
+    // shared with the decode jobs, which may still be running when the streamer is destroyed at exit
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Job> > decoded;
+        unsigned int decoding = 0;
+    };
+
+    std::shared_ptr<Queue> queue;
+    std::shared_ptr<Job>   current;
+    std::map<unsigned int, std::shared_ptr<Job> > jobs; // loads not finished yet, by texture name
+    unsigned int ring[TEXTURE_UPLOAD_RING];
+    unsigned int ringIndex = 0;
+    bool flipVertically = false;
+    int  s3tcSupported = -1; // unknown until the first load
+    int  s3tcSrgbSupported = -1;
+
+    TextureStreamer() : queue(new Queue())
+    {
+        for (unsigned int i = 0; i < TEXTURE_UPLOAD_RING; i++)
+            ring[i] = 0;
+    }
+
+    bool nextJob()
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->decoded.empty())
+            return false;
+        current = queue->decoded.front();
+        queue->decoded.pop_front();
+        return true;
+    }
+
+    static GLenum formatFor(int channels)
+    {
+        if (channels == 1)
+            return GL_RED;
+        if (channels == 2)
+            return GL_RG;
+        if (channels == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    // what the texture stores, sRGB encoded color where asked for and available
+    static GLenum internalFormatFor(int channels, bool srgb)
+    {
+        if (srgb && channels == 3)
+            return GL_SRGB8;
+        if (srgb && channels == 4)
+            return GL_SRGB8_ALPHA8;
+        return formatFor(channels);
+    }
+
+    // the sRGB twin of a block format, the blocks are the same, only sampling decodes them
+    static GLenum compressedFormatFor(GLenum internalFormat, bool srgb)
+    {
+        if (srgb && internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+            return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        if (srgb && internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        return internalFormat;
+    }
+
+    static int mipLevels(int width, int height)
+    {
+        int levels = 1;
+        while ((width | height) >> levels)
+            levels++;
+        return levels;
+    }
+
+    // allocates the full mip chain and parks the placeholder in the last level
+    void allocate(const Job& job)
+    {
+        GLenum format = formatFor(job.channels);
+        GLenum internalFormat = internalFormatFor(job.channels, job.srgb);
+        int levels = mipLevels(job.width, job.height);
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        for (int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, job.width >> level), std::max(1, job.height >> level), 0, format, GL_UNSIGNED_BYTE, NULL);
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        glTexSubImage2D(GL_TEXTURE_2D, levels - 1, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+    // s3tc, and with srgb also its sRGB formats, which come with EXT_texture_sRGB
+    bool compressionSupported(bool srgb = false)
+    {
+        if (s3tcSupported < 0)
+        {
+            s3tcSupported = s3tcSrgbSupported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+                if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                    s3tcSupported = 1;
+                if (name && (strcmp(name, "GL_EXT_texture_sRGB") == 0 || strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0))
+                    s3tcSrgbSupported = 1;
+            }
+        }
+        return s3tcSupported == 1 && (!srgb || s3tcSrgbSupported == 1);
+    }
+
+    // copies bytes into the next pixel buffer of the ring and leaves it bound. returns the pointer to pass
+    // to the gl*TexSubImage call: an offset into the buffer, or the client memory itself when it doesn't fit.
+    const void* stage(const unsigned char* src, size_t bytes)
+    {
+        if (!ring[0])
+        {
+            glGenBuffers(TEXTURE_UPLOAD_RING, ring);
+            for (unsigned int i = 0; i < TEXTURE_UPLOAD_RING; i++)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring[i]);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_UPLOAD_BUDGET, NULL, GL_STREAM_DRAW);
+            }
+        }
+
+        if (bytes <= TEXTURE_UPLOAD_BUDGET)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring[ringIndex]);
+            ringIndex = (ringIndex + 1) % TEXTURE_UPLOAD_RING;
+            // orphan the previous contents so mapping never waits for an upload still in flight
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_UPLOAD_BUDGET, NULL, GL_STREAM_DRAW);
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst)
+            {
+                memcpy(dst, src, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                return NULL; // offset 0 into the bound buffer
+            }
+        }
+        // a single row wider than the ring, upload it from client memory
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return src;
+    }
+
+    // copies as many whole rows as fit into the budget (at least one) through the next pixel buffer
+    size_t uploadRows(Job& job, size_t budget)
+    {
+        size_t rowBytes = static_cast<size_t>(job.width) * job.channels;
+        size_t maxRows = std::min(budget, TEXTURE_UPLOAD_BUDGET) / rowBytes;
+        int rows = static_cast<int>(std::min(std::max<size_t>(maxRows, 1), static_cast<size_t>(job.height - job.rowsUploaded)));
+        size_t bytes = rowBytes * rows;
+
+        const void* src = stage(job.pixels + rowBytes * job.rowsUploaded, bytes);
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job.rowsUploaded, job.width, rows, formatFor(job.channels), GL_UNSIGNED_BYTE, src);
+        job.rowsUploaded += rows;
+        return bytes;
+    }
+
+    // uploads rows of 4x4 blocks, smallest mip level first. every finished level becomes the new base level.
+    size_t uploadBlocks(Job& job, size_t budget)
+    {
+        const CompressedImage& image = job.compressed;
+        GLenum internalFormat = compressedFormatFor(image.internalFormat, job.srgb);
+        int levels = static_cast<int>(image.levels.size());
+        if (job.level == INT_MAX)
+        {
+            job.level = levels - 1;
+            job.rowsUploaded = 0;
+        }
+
+        size_t uploaded = 0;
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        while (job.level >= 0 && uploaded < budget)
+        {
+            const CompressedLevel& level = image.levels[job.level];
+            int blockRows = (level.height + 3) / 4;
+            size_t rowBytes = level.size / blockRows;
+            if (job.rowsUploaded == 0)
+            {
+                // stage() leaves the ring bound, NULL has to mean no data rather than offset 0 into it
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glCompressedTexImage2D(GL_TEXTURE_2D, job.level, internalFormat, level.width, level.height, 0, static_cast<GLsizei>(level.size), NULL);
+            }
+
+            size_t maxRows = std::min(budget - uploaded, TEXTURE_UPLOAD_BUDGET) / rowBytes;
+            int rows = static_cast<int>(std::min(std::max<size_t>(maxRows, 1), static_cast<size_t>(blockRows - job.rowsUploaded)));
+            size_t bytes = rowBytes * rows;
+            int y = job.rowsUploaded * 4;
+            int height = std::min(rows * 4, level.height - y);
+
+            const void* src = stage(&image.data[level.offset + rowBytes * job.rowsUploaded], bytes);
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, job.level, 0, y, level.width, height, internalFormat, static_cast<GLsizei>(bytes), src);
+            job.rowsUploaded += rows;
+            uploaded += bytes;
+
+            if (job.rowsUploaded == blockRows)
+            {
+                // levels below this one are all complete, sample from here on
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.level);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+                job.level--;
+                job.rowsUploaded = 0;
+            }
+        }
+        return uploaded;
+    }
+
+    // level 0 is complete: switch away from the placeholder and build the mips (compressed images bring their own)
+    void finish(Job& job)
+    {
+        size_t bytes;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, job.texture);
+        if (job.compressed.valid())
+        {
+            bytes = job.compressed.data.size();
+            std::vector<unsigned char>().swap(job.compressed.data);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            stbi_image_free(job.pixels);
+            job.pixels = NULL;
+            bytes = static_cast<size_t>(job.width) * job.height * job.channels * 4 / 3;
+        }
+        jobs.erase(job.texture);
+        if (job.onComplete)
+            job.onComplete(bytes);
+    }
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+};
+#endif
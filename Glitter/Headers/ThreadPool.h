@@ -0,0 +1,139 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads pulling jobs off a shared queue.
+// workers never touch the GL context, anything that needs GL has to go back to the context thread.
+class ThreadPool
+{
+public:
+    // 0 threads means one per hardware thread, minus the one the caller is running on
+    explicit ThreadPool(unsigned int threads = 0)
+    {
+        if (threads == 0)
+        {
+            unsigned int hw = std::thread::hardware_concurrency();
+            threads = hw > 1 ? hw - 1 : 1;
+        }
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    // process-wide pool shared by the loaders
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // queues a job and returns immediately
+    void enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // runs body(i) for every i in [0, count) and returns once all of them finished.
+    // the calling thread works through the range too, so this is safe to call from inside a job.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || workers.empty())
+        {
+            for (size_t i = 0; i < count; i++)
+                body(i);
+            return;
+        }
+
+        // helpers can start after we returned (they then find no work left), so the state lives on the heap
+        std::shared_ptr<ForState> state(new ForState(count, body));
+        size_t helpers = std::min(workers.size(), count - 1);
+        for (size_t h = 0; h < helpers; h++)
+            enqueue([state]() { state->run(); });
+
+        state->run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+    }
+
+private:
+    struct ForState {
+        ForState(size_t n, const std::function<void(size_t)>& f) : count(n), body(f), next(0), done(0) {}
+
+        void run()
+        {
+            size_t i;
+            while ((i = next++) < count)
+            {
+                body(i);
+                if (++done == count)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.notify_all();
+                }
+            }
+        }
+
+        const size_t count;
+        std::function<void(size_t)> body;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+#endif
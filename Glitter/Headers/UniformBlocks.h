@@ -0,0 +1,77 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+// binding points of the uniform blocks all programs share
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint HUE_BLOCK_BINDING = 1;
+
+// std140 layout of the Camera block, see model.vs
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 lightDir;
+    float     pad;
+};
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 layout");
+
+// std140 layout of the Hue block, see model.fs. a vec3 is aligned to 16 bytes but only 12 long,
+// the following float fills the gap.
+struct HueBlock {
+    glm::vec3 cool;
+    float     pad0;
+    glm::vec3 warm;
+    float     alpha;
+    float     beta;
+    float     pad1[3];
+};
+static_assert(sizeof(HueBlock) == 48, "HueBlock must match the std140 layout");
+
+// a uniform buffer bound to a fixed binding point. update() it once per frame, every program
+// attach()ed to it reads the same data.
+template <typename Block>
+class UniformBlock
+{
+public:
+    UniformBlock(const char* name, GLuint binding) : name(name), binding(binding)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    ~UniformBlock()
+    {
+        glDeleteBuffers(1, &buffer);
+    }
+
+    // points the program's block of this name at our binding, programs without it are left alone
+    void attach(const Shader& shader) const
+    {
+        GLuint index = glGetUniformBlockIndex(shader.ID, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, binding);
+    }
+
+    void update(const Block& data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    const char* name;
+    GLuint      binding;
+    GLuint      buffer = 0;
+
+    UniformBlock(const UniformBlock&);
+    UniformBlock& operator=(const UniformBlock&);
+};
+#endif
@@ -0,0 +1,116 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// how positions are stored on the GPU
+enum Position_Format {
+    POSITION_FLOAT,   // 3 floats, 12 bytes
+    POSITION_HALF,    // 3 half floats padded to 8 bytes
+    POSITION_SNORM16  // 3 shorts padded to 8 bytes, relative to the mesh bounds (see Mesh::positionScale)
+};
+
+// GPU vertex layout of a mesh. the CPU side (Vertex, the mesh cache) always keeps full floats,
+// this only decides what gets uploaded and how the attributes are fed to the shaders.
+struct VertexFormat {
+    Position_Format position;
+    bool packedNormals;  // Normal and FaceNormal as normalized GL_INT_2_10_10_10_REV, 4 bytes each
+    bool halfTexCoords;  // TexCoords as 2 half floats
+    bool shortIndices;   // GL_UNSIGNED_SHORT indices for meshes with at most 65536 vertices
+    bool splitPositions; // positions in a buffer of their own, the depth-only pass reads nothing else
+
+    // the Vertex struct uploaded as is, every attribute interleaved. 88 bytes per vertex.
+    static VertexFormat full()
+    {
+        VertexFormat format = { POSITION_FLOAT, false, false, false, false };
+        return format;
+    }
+
+    // 8 bytes of positions plus 12 bytes of normal/uv/face normal. bitangents and bone data
+    // aren't read by any of our shaders and are left out.
+    static VertexFormat compact()
+    {
+        VertexFormat format = { POSITION_SNORM16, true, true, true, true };
+        return format;
+    }
+
+    bool isFull() const
+    {
+        return position == POSITION_FLOAT && !packedNormals && !halfTexCoords && !splitPositions;
+    }
+
+    unsigned int positionSize() const
+    {
+        return position == POSITION_FLOAT ? 12 : 8;
+    }
+
+    unsigned int normalSize() const
+    {
+        return packedNormals ? 4 : 12;
+    }
+
+    unsigned int texCoordSize() const
+    {
+        return halfTexCoords ? 4 : 8;
+    }
+};
+
+// IEEE 754 binary16, round to nearest even
+inline uint16_t packHalf(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t biased = (f >> 23) & 0xffu;
+    uint32_t mantissa = f & 0x7fffffu;
+
+    if (biased == 0xffu) // inf, nan
+        return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    int exponent = static_cast<int>(biased) - 127 + 15;
+    if (exponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    if (exponent <= 0)
+    {
+        // denormal or zero
+        if (exponent < -10)
+            return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++; // a carry into the exponent is still the correctly rounded value
+    return static_cast<uint16_t>(sign | half);
+}
+
+// x, y, z into the low 30 bits of a GL_INT_2_10_10_10_REV, read back by the shader as a normalized vec3
+inline uint32_t packNormal(const glm::vec3& n)
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float c = n[i] != n[i] ? 0.0f : (n[i] < -1.0f ? -1.0f : (n[i] > 1.0f ? 1.0f : n[i]));
+        int value = static_cast<int>(std::floor(c * 511.0f + 0.5f));
+        packed |= (static_cast<uint32_t>(value) & 0x3ffu) << (10 * i);
+    }
+    return packed;
+}
+
+// value in [-1, 1] to a short, decoded as an integer (not normalized) so the result is exact on every GL version
+inline int16_t packSnorm16(float value)
+{
+    float c = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return static_cast<int16_t>(std::floor(c * 32767.0f + 0.5f));
+}
+#endif
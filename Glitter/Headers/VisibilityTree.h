@@ -0,0 +1,144 @@
+#ifndef VISIBILITY_TREE_H
+#define VISIBILITY_TREE_H
+
+#include <glm/glm.hpp>
+#include <BulletCollision/BroadphaseCollision/btDbvt.h>
+
+#include "mesh.h"
+#include "Meshlet.h"
+#include "model.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// every mesh of the scene as a world-space box in Bullet's dynamic AABB tree. a frustum query marks the
+// meshes it touches visible and all others hidden, the Model draw calls then skip the hidden ones, so
+// the cost of a frame follows what is on screen instead of what is loaded.
+class VisibilityTree
+{
+public:
+    // inserts the meshes of a model, or moves them when its world matrix changed since the last call.
+    // cheap to call every frame for models that don't move.
+    void place(Model& model, const glm::mat4& world)
+    {
+        Entry* entry = find(model);
+        if (!entry)
+        {
+            entries.push_back(Entry());
+            entry = &entries.back();
+            entry->model = &model;
+        }
+        // the leaves point at the meshes, a reallocated mesh vector means inserting again
+        bool moved = entry->leaves.size() != model.meshes.size() || (!model.meshes.empty() && entry->first != &model.meshes[0]);
+        if (moved)
+        {
+            removeLeaves(*entry);
+            entry->first = model.meshes.empty() ? NULL : &model.meshes[0];
+        }
+        else if (memcmp(&entry->world, &world, sizeof(world)) == 0)
+            return;
+        entry->world = world;
+
+        for (size_t i = 0; i < model.meshes.size(); i++)
+        {
+            Mesh& mesh = model.meshes[i];
+            btDbvtVolume volume = worldBounds(mesh, world);
+            if (moved)
+                entry->leaves.push_back(tree.insert(volume, &mesh));
+            else
+                tree.update(entry->leaves[i], volume);
+        }
+    }
+
+    // takes a model out of the tree, before it is destroyed or when it leaves the scene
+    void remove(Model& model)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].model == &model)
+            {
+                removeLeaves(entries[i]);
+                entries.erase(entries.begin() + i);
+                return;
+            }
+    }
+
+    // marks the meshes inside the frustum of projection * view visible, all others hidden.
+    // returns the number of visible meshes.
+    size_t cull(const glm::mat4& viewProjection)
+    {
+        for (size_t e = 0; e < entries.size(); e++)
+            for (size_t i = 0; i < entries[e].model->meshes.size(); i++)
+                entries[e].model->meshes[i].visible = false;
+
+        // Bullet classifies a box as inside a plane when dot(n, x) + o >= 0, the same convention as frustumPlanes
+        glm::vec4 planes[6];
+        MeshletCuller::frustumPlanes(viewProjection, planes);
+        btVector3 normals[6];
+        btScalar offsets[6];
+        for (int p = 0; p < 6; p++)
+        {
+            normals[p] = btVector3(planes[p].x, planes[p].y, planes[p].z);
+            offsets[p] = planes[p].w;
+        }
+
+        MarkVisible marker;
+        btDbvt::collideKDOP(tree.m_root, normals, offsets, 6, marker);
+
+        // a rebalancing pass a frame keeps the tree tight as boxes move
+        tree.optimizeIncremental(1);
+        return marker.visible;
+    }
+
+private:
+    struct Entry {
+        Model*              model = NULL;
+        const Mesh*         first = NULL;
+        glm::mat4           world = glm::mat4(1.0f);
+        vector<btDbvtNode*> leaves;
+    };
+
+    struct MarkVisible : btDbvt::ICollide {
+        size_t visible = 0;
+        void Process(const btDbvtNode* leaf)
+        {
+            static_cast<Mesh*>(leaf->data)->visible = true;
+            visible++;
+        }
+    };
+
+    btDbvt        tree;
+    vector<Entry> entries;
+
+    Entry* find(Model& model)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].model == &model)
+                return &entries[i];
+        return NULL;
+    }
+
+    void removeLeaves(Entry& entry)
+    {
+        for (size_t i = 0; i < entry.leaves.size(); i++)
+            tree.remove(entry.leaves[i]);
+        entry.leaves.clear();
+    }
+
+    // the mesh's model-space box transformed to world space (Arvo): the center moves, the half
+    // extent grows by the absolute value of the rotation/scale part
+    static btDbvtVolume worldBounds(const Mesh& mesh, const glm::mat4& world)
+    {
+        glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+        glm::vec3 extent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+        glm::vec3 worldCenter = glm::vec3(world * glm::vec4(center, 1.0f));
+        glm::vec3 worldExtent(0.0f);
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                worldExtent[r] += fabs(world[c][r]) * extent[c];
+        glm::vec3 lo = worldCenter - worldExtent, hi = worldCenter + worldExtent;
+        return btDbvtVolume::FromMM(btVector3(lo.x, lo.y, lo.z), btVector3(hi.x, hi.y, hi.z));
+    }
+};
+#endif
@@ -7,8 +7,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "TextureCache.h"
+#include "VertexFormat.h"
+#include "Meshlet.h"
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -35,6 +40,170 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    shared_ptr<TextureHandle> handle; // keeps the cached GL texture alive while a mesh uses it
+};
+
+// a texture a mesh refers to, before it has been loaded
+struct TextureRef {
+    string type;
+    string path;
+};
+
+// a level of detail: a range of the mesh's index buffer
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float        error; // largest deviation from the full mesh, in model units
+    unsigned int firstMeshlet;
+    unsigned int meshletCount;
+};
+
+// CPU-side result of importing one mesh. building it doesn't touch GL, so it can happen on any thread.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<TextureRef>   textures;
+    glm::vec3            diffuse = glm::vec3(0.0f, 0.0f, 0.0f);
+    bool                 diffuse_map = true;
+    vector<MeshLod>      lods; // empty: the whole index buffer is the only level
+    vector<Meshlet>      meshlets;
+};
+
+// writes vertices in a packed VertexFormat and points the vertex attributes at the result.
+// positions go into the attribute records, or with splitPositions into a stream of their own.
+struct VertexPacker {
+    VertexFormat format;
+    glm::vec3    positionScale;
+    glm::vec3    positionOffset;
+    unsigned int positionSize;
+    unsigned int normalOffset;
+    unsigned int texCoordOffset;
+    unsigned int faceNormalOffset;
+    unsigned int stride; // of the attribute records
+
+    VertexPacker(const VertexFormat& format, const glm::vec3& positionScale, const glm::vec3& positionOffset)
+        : format(format), positionScale(positionScale), positionOffset(positionOffset)
+    {
+        positionSize = format.positionSize();
+        normalOffset = format.splitPositions ? 0 : positionSize;
+        texCoordOffset = normalOffset + format.normalSize();
+        faceNormalOffset = texCoordOffset + format.texCoordSize();
+        stride = faceNormalOffset + format.normalSize();
+    }
+
+    // the scale and offset that map the box of the vertices onto the snorm16 range
+    static void snormRange(const Vertex* vertices, size_t count, glm::vec3& scale, glm::vec3& offset)
+    {
+        glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+        for (size_t i = 1; i < count; i++)
+        {
+            lo = glm::min(lo, vertices[i].Position);
+            hi = glm::max(hi, vertices[i].Position);
+        }
+        offset = (lo + hi) * 0.5f;
+        glm::vec3 extent = glm::max((hi - lo) * 0.5f, glm::vec3(1e-20f));
+        scale = extent / 32767.0f;
+    }
+
+    // attributes gets count * stride bytes, positions count * positionSize when the format splits them
+    void pack(const Vertex* vertices, size_t count, unsigned char* attributes, unsigned char* positions) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const Vertex& v = vertices[i];
+            unsigned char* record = attributes + i * stride;
+            writePosition(format.splitPositions ? positions + i * positionSize : record, v.Position);
+            writeNormal(record + normalOffset, v.Normal);
+            writeNormal(record + faceNormalOffset, v.FaceNormal);
+            if (format.halfTexCoords)
+            {
+                uint16_t uv[2] = { packHalf(v.TexCoords.x), packHalf(v.TexCoords.y) };
+                memcpy(record + texCoordOffset, uv, sizeof(uv));
+            }
+            else
+                memcpy(record + texCoordOffset, &v.TexCoords, sizeof(v.TexCoords));
+        }
+    }
+
+    // attributes 1-3 from the currently bound array buffer
+    void attributePointers() const
+    {
+        glEnableVertexAttribArray(1);
+        normalPointer(1, normalOffset);
+        glEnableVertexAttribArray(2);
+        if (format.halfTexCoords)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(size_t)texCoordOffset);
+        else
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)texCoordOffset);
+        glEnableVertexAttribArray(3);
+        normalPointer(3, faceNormalOffset);
+    }
+
+    // attribute 0 from the currently bound array buffer
+    void positionPointer() const
+    {
+        GLsizei positionStride = format.splitPositions ? positionSize : stride;
+        glEnableVertexAttribArray(0);
+        if (format.position == POSITION_FLOAT)
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, positionStride, (void*)0);
+        else if (format.position == POSITION_HALF)
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, positionStride, (void*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, positionStride, (void*)0);
+    }
+
+private:
+    void writePosition(unsigned char* out, const glm::vec3& p) const
+    {
+        if (format.position == POSITION_FLOAT)
+            memcpy(out, &p, sizeof(p));
+        else if (format.position == POSITION_HALF)
+        {
+            uint16_t h[4] = { packHalf(p.x), packHalf(p.y), packHalf(p.z), 0 };
+            memcpy(out, h, sizeof(h));
+        }
+        else
+        {
+            glm::vec3 q = (p - positionOffset) / positionScale / 32767.0f;
+            int16_t s[4] = { packSnorm16(q.x), packSnorm16(q.y), packSnorm16(q.z), 0 };
+            memcpy(out, s, sizeof(s));
+        }
+    }
+
+    void writeNormal(unsigned char* out, const glm::vec3& n) const
+    {
+        if (format.packedNormals)
+        {
+            uint32_t packed = packNormal(n);
+            memcpy(out, &packed, sizeof(packed));
+        }
+        else
+            memcpy(out, &n, sizeof(n));
+    }
+
+    void normalPointer(unsigned int index, unsigned int offset) const
+    {
+        // packed types only come in 4 components, the shaders just read xyz
+        if (format.packedNormals)
+            glVertexAttribPointer(index, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)offset);
+        else
+            glVertexAttribPointer(index, 3, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)offset);
+    }
+};
+
+// a GL object name that moves but doesn't copy, so a mesh that's moved (e.g. when a vector<Mesh> grows)
+// hands its objects over and only the last owner deletes them
+struct GLName {
+    unsigned int name = 0;
+
+    GLName() {}
+    GLName(GLName&& other) noexcept : name(other.name) { other.name = 0; }
+    GLName& operator=(GLName&& other) noexcept { std::swap(name, other.name); return *this; }
+    operator unsigned int() const { return name; }
+
+private:
+    GLName(const GLName&);
+    GLName& operator=(const GLName&);
 };
 
 class Mesh {
@@ -45,90 +214,273 @@ public:
     vector<Texture>      textures;
     glm::vec3            diffuse = glm::vec3(0.0f, 0.0f, 0.0f);
     bool                 diffuse_map = true; // assume diffuse map by default
-    unsigned int VAO;
+    unsigned int         material = 0;       // index in MaterialTable, set by Model::createMesh
+    GLName       VAO;
+    GLName       depthVAO; // only feeds positions, see DrawDepthOnly
+    VertexFormat format;
+    GLenum       indexType = GL_UNSIGNED_INT;
+    // snorm16 positions are stored relative to the mesh bounds, the vertex shaders undo it with these
+    glm::vec3    positionScale = glm::vec3(1.0f, 1.0f, 1.0f);
+    glm::vec3    positionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+    size_t       gpuBytes = 0; // vertex + index buffer size
+    vector<MeshLod> lods;      // levels of detail, finest first. empty: draw every index
+    unsigned int lod = 0;      // level the draw calls use, picked by Model::selectLods
+    glm::vec3    boundsCenter = glm::vec3(0.0f, 0.0f, 0.0f); // bounding sphere in model space
+    float        boundsRadius = 0.0f;
+    glm::vec3    boundsMin = glm::vec3(0.0f, 0.0f, 0.0f);    // box in model space, see VisibilityTree
+    glm::vec3    boundsMax = glm::vec3(0.0f, 0.0f, 0.0f);
+    bool         visible = true; // cleared by VisibilityTree::cull when outside the frustum
+    vector<Meshlet> meshlets;  // of every level, see MeshLod::firstMeshlet
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // the buffers are taken by value, pass them with move() to hand them over without a copy
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VertexFormat::full())
+        : vertices(move(vertices)), indices(move(indices)), textures(move(textures)), format(format)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // the GL objects go along, the mesh left behind has none
+    Mesh(Mesh&&) = default;
+
+    ~Mesh()
+    {
+        releaseBuffers();
+    }
+
+    // deletes the vertex arrays and buffers. the mesh keeps its vertices and indices, which is all a
+    // ModelBatch needs, but its own draw calls do nothing from then on.
+    void releaseBuffers()
+    {
+        if (VAO)
+        {
+            glDeleteVertexArrays(1, &VAO.name);
+            glDeleteVertexArrays(1, &depthVAO.name);
+            glDeleteBuffers(1, &VBO.name);
+            glDeleteBuffers(1, &EBO.name);
+        }
+        if (positionVBO)
+            glDeleteBuffers(1, &positionVBO.name);
+        VAO.name = depthVAO.name = VBO.name = EBO.name = positionVBO.name = 0;
+        gpuBytes = 0;
+    }
+
     void DrawToBuffer(Shader& shader) {
+        if (!VAO)
+            return;
+        setPositionDecode(shader);
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        GLState::instance().bindVertexArray(VAO);
+        drawElements();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // draws with nothing but positions bound, for passes that only need depth
+    void DrawDepthOnly(Shader& shader) {
+        if (!VAO)
+            return;
+        setPositionDecode(shader);
+        GLState::instance().bindVertexArray(depthVAO);
+        drawElements();
+    }
+
+    void setMeshlets(vector<Meshlet> clusters)
+    {
+        meshlets = move(clusters);
+        meshletBounds.assign(meshlets);
+        culled = false;
+    }
+
+    // culls the meshlets of the current level against the frustum planes and camera (both in model space).
+    // the draw calls then only submit what survived, until the next call or until culling is turned off.
+    void cullMeshlets(const glm::vec4 planes[6], const glm::vec3& camera, bool backfaces, MeshletCullStats& stats)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        culled = false;
+        if (lods.empty() || meshlets.empty())
+            return;
+        const MeshLod& range = lods[lod < lods.size() ? lod : lods.size() - 1];
+        if (!range.meshletCount)
+            return;
+
+        visibility.resize(range.meshletCount);
+        MeshletCuller::cull(meshletBounds, range.firstMeshlet, range.meshletCount, planes, camera, backfaces, visibility.data());
+
+        // neighbouring visible meshlets are contiguous in the index buffer, they become one draw
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        drawCounts.clear();
+        drawOffsets.clear();
+        unsigned int end = ~0u;
+        for (unsigned int i = 0; i < range.meshletCount; i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            const Meshlet& m = meshlets[range.firstMeshlet + i];
+            stats.meshlets++;
+            stats.triangles += m.indexCount / 3;
+            if (!visibility[i])
+                continue;
+            stats.visibleMeshlets++;
+            stats.visibleTriangles += m.indexCount / 3;
+            if (m.firstIndex == end)
+                drawCounts.back() += m.indexCount;
+            else
+            {
+                drawCounts.push_back(m.indexCount);
+                drawOffsets.push_back((const void*)(m.firstIndex * indexSize));
+            }
+            end = m.firstIndex + m.indexCount;
         }
+        culled = true;
+    }
+
+    void resetCulling()
+    {
+        culled = false;
+    }
 
-        // material diffuse
-        shader.setVec3("material.diffuse", diffuse);
-        shader.setBool("isMap", diffuse_map);
+    // render the mesh
+    // draws with the material already applied, see MaterialTable::apply
+    void Draw(Shader& shader)
+    {
+        if (!VAO)
+            return;
+        setPositionDecode(shader);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        GLState::instance().bindVertexArray(VAO);
+        drawElements();
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    void drawRanges(vector<unsigned int>& firsts, vector<unsigned int>& counts) const
+    {
+        if (culled)
+        {
+            size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+            for (size_t i = 0; i < drawCounts.size(); i++)
+            {
+                firsts.push_back(static_cast<unsigned int>((size_t)drawOffsets[i] / indexSize));
+                counts.push_back(static_cast<unsigned int>(drawCounts[i]));
+            }
+            return;
+        }
+        if (lods.empty())
+        {
+            firsts.push_back(0);
+            counts.push_back(static_cast<unsigned int>(indices.size()));
+            return;
+        }
+        const MeshLod& range = lods[lod < lods.size() ? lod : lods.size() - 1];
+        firsts.push_back(range.firstIndex);
+        counts.push_back(range.indexCount);
     }
 
 private:
+    // owns its GL objects, moves only
+    Mesh(const Mesh&);
+    Mesh& operator=(const Mesh&);
+
     // render data 
-    unsigned int VBO, EBO;
+    GLName VBO, EBO;
+    GLName positionVBO;
+    MeshletBounds meshletBounds;
+    vector<unsigned char> visibility;
+    vector<GLsizei>       drawCounts;  // surviving index ranges after cullMeshlets
+    vector<const void*>   drawOffsets;
+    bool                  culled = false;
+
+    // the index range of the current level of detail, or what is left of it after meshlet culling
+    void drawElements()
+    {
+        if (culled)
+        {
+            if (!drawCounts.empty())
+                glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), static_cast<GLsizei>(drawCounts.size()));
+            return;
+        }
+        if (lods.empty())
+        {
+            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), indexType, 0);
+            return;
+        }
+        const MeshLod& range = lods[lod < lods.size() ? lod : lods.size() - 1];
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        glDrawElements(GL_TRIANGLES, range.indexCount, indexType, (void*)(range.firstIndex * indexSize));
+    }
+
+    void setPositionDecode(Shader& shader)
+    {
+        shader.setVec3("positionScale", positionScale);
+        shader.setVec3("positionOffset", positionOffset);
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        computeBounds();
+
         // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        glGenVertexArrays(1, &VAO.name);
+        glGenVertexArrays(1, &depthVAO.name);
+        glGenBuffers(1, &VBO.name);
+        glGenBuffers(1, &EBO.name);
 
+        // the element buffer binding is part of the VAO state, so both VAOs get it
+        glBindVertexArray(VAO);
+        setupIndices();
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        if (format.isFull())
+            setupFullLayout();
+        else
+            setupPackedLayout();
+        glBindVertexArray(0);
+    }
+
+    // box of all vertices and the sphere around it, loose but cheap and stable
+    void computeBounds()
+    {
+        if (vertices.empty())
+            return;
+        glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            lo = glm::min(lo, vertices[i].Position);
+            hi = glm::max(hi, vertices[i].Position);
+        }
+        boundsMin = lo;
+        boundsMax = hi;
+        boundsCenter = (lo + hi) * 0.5f;
+        boundsRadius = glm::length(hi - lo) * 0.5f;
+    }
+
+    void setupIndices()
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (format.shortIndices && vertices.size() <= 65536)
+        {
+            vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            indexType = GL_UNSIGNED_SHORT;
+            gpuBytes += shortIndices.size() * sizeof(unsigned short);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            indexType = GL_UNSIGNED_INT;
+            gpuBytes += indices.size() * sizeof(unsigned int);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        }
+    }
+
+    // the Vertex struct as is
+    void setupFullLayout()
+    {
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        gpuBytes += vertices.size() * sizeof(Vertex);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -153,7 +505,43 @@ private:
         // weights
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+
+        glBindVertexArray(depthVAO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    }
+
+    // quantized attributes, positions optionally in a stream of their own
+    void setupPackedLayout()
+    {
+        if (format.position == POSITION_SNORM16 && !vertices.empty())
+            VertexPacker::snormRange(vertices.data(), vertices.size(), positionScale, positionOffset);
+
+        VertexPacker packer(format, positionScale, positionOffset);
+        vector<unsigned char> attributes(vertices.size() * packer.stride);
+        vector<unsigned char> positions(format.splitPositions ? vertices.size() * packer.positionSize : 0);
+        packer.pack(vertices.data(), vertices.size(), attributes.data(), format.splitPositions ? positions.data() : NULL);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, attributes.size(), attributes.data(), GL_STATIC_DRAW);
+        gpuBytes += attributes.size();
+        packer.attributePointers();
+
+        unsigned int positionBuffer = VBO;
+        if (format.splitPositions)
+        {
+            glGenBuffers(1, &positionVBO.name);
+            glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+            gpuBytes += positions.size();
+            positionBuffer = positionVBO;
+        }
+        packer.positionPointer();
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        packer.positionPointer();
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -12,171 +12,403 @@
 
 #include "mesh.h"
 #include "shader.h"
+#include "Material.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "FaceFrames.h"
+#include "ObjLoader.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
+#include "TextureCache.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+// post-processing applied on import. part of the mesh cache key, so changing it re-bakes every cache.
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// marks caches baked by ObjLoader rather than assimp, its output shares vertices between corners
+const unsigned int MODEL_NATIVE_OBJ = 0x80000000u;
 
 class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat format; // GPU layout of every mesh
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const& path, bool gamma = false, VertexFormat format = VertexFormat::compact()) : gammaCorrection(gamma), format(format)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // an empty model, filled mesh by mesh with createMesh (see AsyncModel)
+    explicit Model(VertexFormat format, bool gamma = false) : gammaCorrection(gamma), format(format)
+    {
+    }
+
+    ~Model()
+    {
+        MaterialTable& materials = MaterialTable::instance();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            materials.release(meshes[i].material);
+    }
+
+    // draws the model, and thus all its meshes that aren't culled
     void DrawToBuffer(Shader& shader)
     {
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].DrawToBuffer(shader);
+            if (meshes[i].visible)
+                meshes[i].DrawToBuffer(shader);
     }
 
 
-    // draws the model, and thus all its meshes
+    // draws the model, and thus all its meshes that aren't culled and have a material
     void Draw(Shader& shader)
     {
+        MaterialTable& materials = MaterialTable::instance();
+        materials.begin();
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            if (meshes[i].visible && meshes[i].material != MATERIAL_NONE)
+            {
+                materials.apply(shader, meshes[i].material);
+                meshes[i].Draw(shader);
+            }
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
+    // picks every mesh's level of detail for this frame from the size of its bounding sphere on screen.
+    // a level is used while its error stays below `threshold` pixels, coarser levels only once they are
+    // comfortably below it, so a model hovering at a boundary doesn't flicker between two levels.
+    void selectLods(const glm::mat4& model, const glm::mat4& view, float zoom, float viewportHeight, float threshold = 1.0f)
+    {
+        const float hysteresis = 0.75f;
+        // pixels per model-space unit at distance 1
+        float pixelsPerUnit = viewportHeight * 0.5f / tan(glm::radians(zoom) * 0.5f);
+        float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::mat4 modelView = view * model;
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh& mesh = meshes[i];
+            if (mesh.lods.size() < 2 || !mesh.visible)
+                continue;
+            glm::vec3 center = glm::vec3(modelView * glm::vec4(mesh.boundsCenter, 1.0f));
+            float radius = mesh.boundsRadius * scale;
+            float distance = glm::length(center);
+            if (distance <= radius)
+            {
+                mesh.lod = 0;
+                continue;
+            }
+            // projected radius in pixels, a level's error scales with it relative to the sphere
+            float projected = radius * pixelsPerUnit / distance;
+            float pixelsPerError = mesh.boundsRadius > 0.0f ? projected / mesh.boundsRadius : 0.0f;
+
+            unsigned int lod = min(mesh.lod, static_cast<unsigned int>(mesh.lods.size() - 1));
+            while (lod > 0 && mesh.lods[lod].error * pixelsPerError > threshold)
+                lod--;
+            while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * pixelsPerError < threshold * hysteresis)
+                lod++;
+            mesh.lod = lod;
+        }
+    }
+
+    // culls the meshlets of every mesh's current level against the view frustum and, with backfaces set,
+    // drops clusters that face away from the camera. only set it when the passes cull back faces too
+    // (GLState::setCull), otherwise open and double sided models lose the insides they show. call once
+    // per frame after selectLods, every pass then draws the surviving ranges.
+    MeshletCullStats cullMeshlets(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool backfaces = false)
+    {
+        glm::vec4 planes[6];
+        MeshletCuller::frustumPlanes(projection * view * model, planes);
+        glm::vec3 camera = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+        vector<MeshletCullStats> stats(meshes.size());
+        ThreadPool::shared().parallelFor(meshes.size(), [&](size_t i) {
+            if (meshes[i].visible)
+                meshes[i].cullMeshlets(planes, camera, backfaces, stats[i]);
+        });
+        MeshletCullStats total;
+        for (unsigned int i = 0; i < stats.size(); i++)
+            total.add(stats[i]);
+        return total;
+    }
+
+    // draws the model with only the position stream bound, for depth-only passes
+    void DrawDepthOnly(Shader& shader)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            if (meshes[i].visible)
+                meshes[i].DrawDepthOnly(shader);
+    }
+
+    // everything of loading a model that doesn't touch GL: reading the mesh cache, or importing and
+    // optimizing the file and baking the cache. safe to run on any thread, see AsyncModel.
+    static bool importMeshes(string const& path, vector<MeshData>& data)
     {
+        // .obj files go through the native loader, everything else through assimp
+        string extension = path.substr(path.find_last_of('.') + 1);
+        transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        bool native = extension == "obj";
+
+        // a baked cache of this exact file skips importing entirely
+        MeshCache cache;
+        if (cache.open(path, MODEL_IMPORT_FLAGS | (native ? MODEL_NATIVE_OBJ : 0)))
+        {
+            readCachedMeshes(cache, data);
+            return true;
+        }
+
+        if (native && ObjLoader::load(path, data))
+        {
+            optimizeMeshes(data);
+            if (!cache.store(data))
+                cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::cachePath(path) << endl;
+            return true;
+        }
+        // the fallback's output is keyed (and baked) separately from the native loader's
+        if (native && cache.open(path, MODEL_IMPORT_FLAGS))
+        {
+            readCachedMeshes(cache, data);
+            return true;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('\\'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, data);
+        optimizeMeshes(data);
+
+        if (!cache.store(data))
+            cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::cachePath(path) << endl;
+        return true;
+    }
+
+    // the directory textures are looked up in, either separator
+    static string directoryOf(string const& path)
+    {
+        return path.substr(0, path.find_last_of("/\\"));
+    }
+
+    // uploads processed mesh data and loads its textures. touches GL, so only call this on the context thread.
+    // the vertex, index and meshlet buffers are moved into the mesh, data is left without them.
+    Mesh createMesh(MeshData& data)
+    {
+        vector<Texture> textures;
+        for (unsigned int i = 0; i < data.textures.size(); i++)
+            textures.push_back(loadTexture(data.textures[i].path.c_str(), data.textures[i].type));
+
+        Mesh m = Mesh(move(data.vertices), move(data.indices), textures, format);
+        m.diffuse = data.diffuse;
+        m.diffuse_map = data.diffuse_map;
+        m.material = MaterialTable::instance().add(m.textures, m.diffuse, m.diffuse_map);
+        m.lods = move(data.lods);
+        m.setMeshlets(move(data.meshlets));
+        return m;
+    }
+
+private:
+    // the meshes hold a reference to their materials each
+    Model(const Model&);
+    Model& operator=(const Model&);
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const& path)
+    {
+        // retrieve the directory path of the filepath
+        directory = directoryOf(path);
+
+        vector<MeshData> data;
+        if (!importMeshes(path, data))
+            return;
+        meshes.reserve(data.size());
+        for (unsigned int i = 0; i < data.size(); i++)
+            meshes.push_back(createMesh(data[i]));
+    }
+
+    // copies the meshes out of a mapped cache. the copy is deliberate: meshes keep their vertices and
+    // indices (ModelBatch and the lod/meshlet ranges read them later) while the mapping is closed as soon
+    // as the import is done, and the vectors move on into createMesh without another copy.
+    static void readCachedMeshes(const MeshCache& cache, vector<MeshData>& data)
+    {
+        data.resize(cache.meshes.size());
+        for (unsigned int i = 0; i < cache.meshes.size(); i++)
+        {
+            const CachedMesh& cached = cache.meshes[i];
+            MeshData& mesh = data[i];
+            mesh.vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+            mesh.indices.assign(cached.indices, cached.indices + cached.indexCount);
+            mesh.textures = cached.textures;
+            mesh.diffuse = cached.diffuse;
+            mesh.diffuse_map = cached.diffuseMap;
+            mesh.lods = cached.lods;
+            mesh.meshlets = cached.meshlets;
+        }
+    }
+
+    // processes the node tree. the meshes are collected in the same depth-first order the recursion used to visit them
+    // and built in parallel on the thread pool.
+    static void processNode(aiNode* node, const aiScene* scene, vector<MeshData>& data)
+    {
+        vector<aiMesh*> sceneMeshes;
+        collectMeshes(node, scene, sceneMeshes);
+
+        data.resize(sceneMeshes.size());
+        ScratchArenas arenas;
+        ThreadPool::shared().parallelFor(sceneMeshes.size(), [&](size_t i) {
+            ScratchArenas::Lease arena(arenas);
+            data[i] = processMesh(sceneMeshes[i], scene, *arena);
+        });
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    static void collectMeshes(aiNode* node, const aiScene* scene, vector<aiMesh*>& out)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            out.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            collectMeshes(node->mChildren[i], scene, out);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // reorders every mesh for the post-transform cache, overdraw and vertex fetch, then builds its levels
+    // of detail and meshlets. the meshes get drawn once per pass, so this pays off several times a frame.
+    // runs once per import, the cache keeps the result.
+    static void optimizeMeshes(vector<MeshData>& data)
+    {
+        vector<VertexCacheStats> before(data.size()), after(data.size());
+        ThreadPool::shared().parallelFor(data.size(), [&](size_t i) {
+            MeshOptimizer::optimize(data[i], &before[i]);
+            MeshSimplifier::buildLods(data[i]);
+            MeshletBuilder::build(data[i]);
+            // meshlets reorder the triangles once more, measure what actually gets drawn
+            const MeshLod& full = data[i].lods[0];
+            vector<unsigned int> drawn(data[i].indices.begin() + full.firstIndex, data[i].indices.begin() + full.firstIndex + full.indexCount);
+            after[i] = MeshOptimizer::analyze(drawn, data[i].vertices.size());
+        });
+
+        VertexCacheStats totalBefore, totalAfter;
+        for (unsigned int i = 0; i < data.size(); i++)
+        {
+            totalBefore.add(before[i]);
+            totalAfter.add(after[i]);
+        }
+        cout << "mesh optimizer: ACMR " << totalBefore.acmr() << " -> " << totalAfter.acmr()
+             << ", ATVR " << totalBefore.atvr() << " -> " << totalAfter.atvr() << endl;
+
+        vector<size_t> lodTriangles;
+        for (unsigned int i = 0; i < data.size(); i++)
+            for (unsigned int l = 0; l < data[i].lods.size(); l++)
+            {
+                if (lodTriangles.size() <= l)
+                    lodTriangles.push_back(0);
+                lodTriangles[l] += data[i].lods[l].indexCount / 3;
+            }
+        cout << "mesh lods:";
+        for (unsigned int l = 0; l < lodTriangles.size(); l++)
+            cout << (l ? " / " : " ") << lodTriangles[l];
+        cout << " triangles" << endl;
+    }
+
+    // builds the CPU-side data of a mesh. only reads the scene and doesn't touch GL, so it runs on the worker threads.
+    // the output is sized up front, temporaries come from the import's scratch arena.
+    static MeshData processMesh(aiMesh* mesh, const aiScene* scene, ScratchArena& arena)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex>& vertices = data.vertices;
+        vector<unsigned int>& indices = data.indices;
+
+        // positions are also kept as a structure of arrays for the face normal kernel
+        unsigned int vertexCount = mesh->mNumVertices;
+        vertices.resize(vertexCount);
+        float* x = arena.allocate<float>(vertexCount);
+        float* y = arena.allocate<float>(vertexCount);
+        float* z = arena.allocate<float>(vertexCount);
 
         // walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        for (unsigned int i = 0; i < vertexCount; i++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
+            Vertex& vertex = vertices[i];
+            // assimp uses its own vector class that doesn't directly convert to glm's vec3 class
+            const aiVector3D& position = mesh->mVertices[i];
+            vertex.Position = glm::vec3(position.x, position.y, position.z);
+            x[i] = position.x;
+            y[i] = position.y;
+            z[i] = position.z;
             // normals
             if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
+                vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
             // texture coordinates
             if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
             {
-                glm::vec2 vec;
                 // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
                 // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
                 // tangent (will be overwritten later)
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.FaceNormal = vector;
+                vertex.FaceNormal = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
                 // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+
+        // now walk through each of the mesh's faces and retrieve the corresponding vertex indices. after
+        // triangulation the only other faces left are points and lines, which GL_TRIANGLES can't draw anyway.
+        size_t triangles = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            triangles += mesh->mFaces[i].mNumIndices == 3;
+        indices.resize(triangles * 3);
+        unsigned int* out = indices.data();
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-
-            vector<unsigned int> faceIndices;
-            //std::cout << face.mNumIndices << "\n";
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-            {
-                int index = face.mIndices[j];
-                //std::cout << "index " << j << ": " << index << " ";
-                indices.push_back(index);
-                faceIndices.push_back(index);
-            }
-            //std::cout << "\n";
-
-            // assuming all faces are tri's
-            // get the surface normal of the tri and store in each vertex
-            glm::vec3 Apos = vertices[faceIndices[0]].Position;
-            glm::vec3 Bpos = vertices[faceIndices[1]].Position;
-            glm::vec3 Cpos = vertices[faceIndices[2]].Position;
-
-            //std::cout << "x: " << Apos.x << " " << "y: " << Apos.y << " " << "z: " << Apos.z << "\n";
-
-            glm::vec3 BA = Bpos - Apos;
-            glm::vec3 CA = Cpos - Apos;
-
-            glm::vec3 faceNormal = glm::normalize(glm::cross(BA, CA));
-
-            //std::cout << "x: " << faceNormal.x << " " << "y: " << faceNormal.y << " " << "z: " << faceNormal.z << "\n";
+            const aiFace& face = mesh->mFaces[i];
+            if (face.mNumIndices != 3)
+                continue;
+            out[0] = face.mIndices[0];
+            out[1] = face.mIndices[1];
+            out[2] = face.mIndices[2];
+            out += 3;
+        }
 
-            vertices[faceIndices[0]].FaceNormal = faceNormal;
-            vertices[faceIndices[1]].FaceNormal = faceNormal;
-            vertices[faceIndices[2]].FaceNormal = faceNormal;
+        // the surface normal of every triangle, stored in its vertices. a vertex shared by several
+        // triangles keeps the normal of the last one.
+        float* nx = arena.allocate<float>(triangles);
+        float* ny = arena.allocate<float>(triangles);
+        float* nz = arena.allocate<float>(triangles);
+        FaceFrames::normals(x, y, z, indices.data(), triangles, nx, ny, nz);
+        for (size_t t = 0; t < triangles; t++)
+        {
+            glm::vec3 faceNormal(nx[t], ny[t], nz[t]);
+            vertices[indices[t * 3]].FaceNormal = faceNormal;
+            vertices[indices[t * 3 + 1]].FaceNormal = faceNormal;
+            vertices[indices[t * 3 + 2]].FaceNormal = faceNormal;
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -189,101 +421,50 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
 
-        // return a mesh object created from the extracted mesh data
-        Mesh m = Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it's uploaded by createMesh
         aiColor4D diffuse;
         if (AI_SUCCESS == aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &diffuse)) {
-            m.diffuse = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
-            m.diffuse_map = false;
+            data.diffuse = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+            data.diffuse_map = false;
         }
-        return m;
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // collects the paths of all material textures of a given type. the textures themselves are loaded
+    // (once per path) when the mesh gets created.
+    static void loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, vector<TextureRef>& textures)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            TextureRef ref;
+            ref.type = typeName;
+            ref.path = str.C_Str();
+            textures.push_back(ref);
         }
-        return textures;
     }
-};
-
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
+    // loads a single texture of the given type. textures are shared through the process-wide cache,
+    // so a file is only loaded once no matter how many meshes or models use it. with gammaCorrection
+    // the diffuse maps are sRGB, the other maps hold data rather than color and stay linear.
+    Texture loadTexture(const char* path, const string& typeName)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        Texture texture;
+        bool srgb = gammaCorrection && typeName == "texture_diffuse";
+        texture.handle = TextureCache::instance().acquire(this->directory + '/' + path, srgb, typeName == "texture_normal");
+        texture.id = texture.handle->id;
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
     }
-
-    return textureID;
-}
-#endif
\ No newline at end of file
+};
+#endif
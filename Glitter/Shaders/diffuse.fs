@@ -3,26 +3,23 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D texture_diffuse1;
-
-struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
-};
-
-uniform Material material;
-uniform bool isMap;
+// written by the geometry pass (see GBuffer.h)
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
 
 void main()
 {   
+    // nothing was drawn here, keep the clear color
+    if (texture(gNormal, TexCoords).xy == vec2(0.0))
+        discard;
+
     // object base color
+    vec4 albedo = texture(gAlbedo, TexCoords);
     vec3 objColor;
-    if (isMap) {
-        objColor = vec3(1.0); // texture(texture_diffuse1, TexCoords).xyz;
+    if (albedo.a > 0.5) {
+        objColor = vec3(1.0); // albedo.xyz;
     } else {
-        objColor = material.diffuse;
+        objColor = albedo.xyz;
     }
 
     // vec3 objColor = vec3(0.1, 0.3, 0.3);
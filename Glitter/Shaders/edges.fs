@@ -0,0 +1,81 @@
+#version 330 core
+// r: normal edges, g: depth edges
+out vec2 FragColor;
+  
+in vec2 TexCoords;
+
+// written by the geometry pass (see GBuffer.h)
+uniform sampler2D faceNormals;
+uniform sampler2D depths;
+
+float near = 0.1; 
+float far  = 100.0; 
+
+// the depth buffer's value as linear depth over far, as the geometry pass used to write it
+float linearDepth(float depth) 
+{
+    float z = depth * 2.0 - 1.0; // back to NDC 
+    return (2.0 * near * far) / (far + near - z * (far - near)) / far;
+}
+
+// the G-buffer's octahedral normals back to unit vectors, zero where nothing was drawn
+vec3 decodeNormal(vec2 encoded)
+{
+    if (encoded == vec2(0.0))
+        return vec3(0.0);
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    // one texel of the actual target, whatever its size
+    vec2 texel = 1.0 / vec2(textureSize(faceNormals, 0));
+    float offsetx = texel.x;
+    float offsety = texel.y;
+
+    vec2 offsets[9] = vec2[](
+        vec2(-offsetx,  offsety), // top-left
+        vec2( 0.0f,    offsety), // top-center
+        vec2( offsetx,  offsety), // top-right
+        vec2(-offsetx,  0.0f),   // center-left
+        vec2( 0.0f,    0.0f),   // center-center
+        vec2( offsetx,  0.0f),   // center-right
+        vec2(-offsetx, -offsety), // bottom-left
+        vec2( 0.0f,   -offsety), // bottom-center
+        vec2( offsetx, -offsety)  // bottom-right    
+    );
+
+    // sobel on the normals, both directions summed
+    float sobel[9] = float[](
+        -2, -2,  0,
+        -2,  0,  2,
+         0,  2,  2
+    );
+
+    // laplacian on the depth
+    float kernel[9] = float[](
+        -1, -1, -1,
+        -1,  8, -1,
+        -1, -1, -1
+    );
+    
+    // both operators from the same 9 positions
+    vec3 normalSum = vec3(0.0);
+    float depthSum = 0.0;
+    for(int i = 0; i < 9; i++)
+    {
+        vec2 uv = TexCoords.st + offsets[i];
+        normalSum += decodeNormal(texture(faceNormals, uv).xy) * sobel[i];
+        depthSum += linearDepth(texture(depths, uv).r) * kernel[i];
+    }
+
+    // the depth threshold was tuned on three equal channels, hence the sqrt(3)
+    float normalEdge = length(normalSum) > .8 ? 1.0 : 0.0;
+    float depthEdge = abs(depthSum) * sqrt(3.0) > .5 ? 1.0 : 0.0;
+    FragColor = vec2(normalEdge, depthEdge);
+}
\ No newline at end of file
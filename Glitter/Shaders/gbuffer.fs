@@ -0,0 +1,43 @@
+#version 330 core
+// the color targets of GBuffer.h, depth is the depth buffer's
+layout (location = 0) out vec2 gFaceNormal;
+layout (location = 1) out vec4 gAlbedo;
+layout (location = 2) out vec2 gNormal;
+
+in vec2 TexCoords;
+in vec3 normal;
+in vec3 faceNormal;
+
+uniform sampler2D texture_diffuse1;
+
+// every material of the scene, rgb diffuse color and a = 1 when the diffuse map is used (see Material.h)
+layout (std140) uniform Materials {
+    vec4 materials[1024];
+};
+uniform int materialIndex;
+
+// a unit normal as octahedral coordinates in 0..1, never exactly 0 so that 0 can mean nothing was drawn.
+// that only holds for point sampled targets (GBUFFER_FILTER), filtering would blend it with the background.
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return max(e * 0.5 + 0.5, vec2(1.0 / 65535.0));
+}
+
+void main()
+{
+    // outline inputs
+    gFaceNormal = encodeNormal(faceNormal);
+
+    // object base color
+    vec4 material = materials[materialIndex];
+    vec3 objColor;
+    if (material.a > 0.5) {
+        objColor = texture(texture_diffuse1, TexCoords).xyz;
+    } else {
+        objColor = material.rgb;
+    }
+    gAlbedo = vec4(objColor, material.a);
+    gNormal = encodeNormal(normal);
+}
\ No newline at end of file
@@ -2,38 +2,42 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
-in vec3 normals;
 in vec3 lightDir;
 
-uniform sampler2D texture_diffuse1;
+// written by the geometry pass (see GBuffer.h)
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
 
-struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
-};
-
-struct Hue {
+// shared by every program, updated once per frame (see UniformBlocks.h)
+layout (std140) uniform Hue {
     vec3 cool;
     vec3 warm;
     float alpha;
     float beta;
-};
-
-uniform Material material;
-uniform Hue hue;
-uniform bool isMap;
+} hue;
+
+// the G-buffer's octahedral normals back to unit vectors, zero where nothing was drawn
+vec3 decodeNormal(vec2 encoded)
+{
+    if (encoded == vec2(0.0))
+        return vec3(0.0);
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {   
+    // nothing was drawn here, keep the clear color
+    vec3 normals = decodeNormal(texture(gNormal, TexCoords).xy);
+    if (normals == vec3(0.0))
+        discard;
+
     // object base color
-    vec3 objColor;
-    if (isMap) {
-        objColor = texture(texture_diffuse1, TexCoords).xyz;
-    } else {
-        objColor = material.diffuse;
-    }
+    vec3 objColor = texture(gAlbedo, TexCoords).xyz;
 
     // interpolate between the cool and the warm term
     vec3 k_cool = hue.cool + objColor * hue.alpha;
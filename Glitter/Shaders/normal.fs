@@ -1,55 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-  
-in vec2 TexCoords;
-
-uniform sampler2D screenTexture;
-
-const float offsetx = 1.0 / 800.0; 
-const float offsety = 1.0 / 600.0; 
-
-void main()
-{
-    vec2 offsets[9] = vec2[](
-        vec2(-offsetx,  offsety), // top-left
-        vec2( 0.0f,    offsety), // top-center
-        vec2( offsetx,  offsety), // top-right
-        vec2(-offsetx,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( offsetx,  0.0f),   // center-right
-        vec2(-offsetx, -offsety), // bottom-left
-        vec2( 0.0f,   -offsety), // bottom-center
-        vec2( offsetx, -offsety)  // bottom-right    
-    );
-
-    float sobelX[9] = float[](
-        -1, 0, 1,
-        -2, 0, 2,
-        -1, 0, 1
-    );
-
-    float sobelY[9] = float[](
-        -1, -2, -1,
-        0, 0, 0,
-        1, 2, 1
-    );
-    
-    vec3 sampleTex[9];
-    for(int i = 0; i < 9; i++)
-    {
-        sampleTex[i] = vec3(texture(screenTexture, TexCoords.st + offsets[i]));
-    }
-    vec3 col = vec3(0.0);
-    for(int i = 0; i < 9; i++) {
-        col += sampleTex[i] * sobelX[i];
-        col += sampleTex[i] * sobelY[i];
-    }
-    if(length(col) > .8) {
-        FragColor = vec4(1.0);
-    } else {
-        FragColor = vec4(0.0);
-    }
-
-    
-    
-}  
\ No newline at end of file
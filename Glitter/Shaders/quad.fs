@@ -4,10 +4,42 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D normalTexture;
+// shows one channel as grey, e.g. one of the edge masks (see edges.fs). -1 shows the texture as is
+uniform int channel = -1;
+// what the texture holds: 0 colors, 1 octahedral normals (shown as rgb), 2 a depth buffer (shown linear)
+uniform int content = 0;
+
+float near = 0.1; 
+float far  = 100.0; 
+
+// the depth buffer's value as linear depth over far, as the geometry pass used to write it
+float linearDepth(float depth) 
+{
+    float z = depth * 2.0 - 1.0; // back to NDC 
+    return (2.0 * near * far) / (far + near - z * (far - near)) / far;
+}
+
+// the G-buffer's octahedral normals back to unit vectors, zero where nothing was drawn
+vec3 decodeNormal(vec2 encoded)
+{
+    if (encoded == vec2(0.0))
+        return vec3(0.0);
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
     
-    FragColor = texture(normalTexture, TexCoords.st);
+    vec4 color = texture(normalTexture, TexCoords.st);
+    if (content == 1)
+        color = vec4(max(decodeNormal(color.xy), 0.0), 1.0);
+    else if (content == 2)
+        color = vec4(vec3(linearDepth(color.r)), 1.0);
+    FragColor = channel < 0 ? color : vec4(vec3(color[channel]), 1.0);
     
-}  
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,9 +0,0 @@
-#version 330 core
-layout(location = 0) out vec4 normalColor;
-
-in vec3 normal;
-
-void main()
-{
-    normalColor = vec4(normal, 1.0);
-}
\ No newline at end of file
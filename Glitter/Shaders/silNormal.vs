@@ -1,15 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 3) in vec3 aNormal;
-
-out vec3 normal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    normal = aNormal;   
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
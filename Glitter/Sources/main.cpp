@@ -1,9 +1,19 @@
 // Local Headers
 #include "glitter.hpp"
 #include "shader.h"
+#include "GLState.h"
+#include "UniformBlocks.h"
 #include "camera.h"
 #include "model.h"
-#include "TextureBuffer.h"
+#include "AsyncModel.h"
+#include "BatchRenderer.h"
+#include "FrameCapture.h"
+#include "ResolutionGovernor.h"
+#include "SceneRenderer.h"
+#include "TextureStreamer.h"
+#ifdef GLITTER_HEADLESS
+#include "HeadlessContext.h"
+#endif
 
 // System Headers
 #include <glad/glad.h>
@@ -14,19 +24,15 @@
 // Standard Headers
 #include <cstdio>
 #include <cstdlib>
-
-struct Hue {
-    glm::vec3 cool;
-    glm::vec3 warm;
-    float alpha;
-    float beta;
-};
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 void processRender(unsigned int key);
+int compressTextures(int count, char* files[]);
+int renderBatch(int count, char* args[], const string& glitterDir);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -42,6 +48,10 @@ struct Hue hue = {
 
  int renderPassFlags = 0;
 
+// P saves a screenshot, V starts and stops recording a video. set by processInput, once per press.
+bool screenshotRequested = false;
+bool recordingToggled = false;
+
 // camera
 Camera camera(glm::vec3(-10.0f, 10.0f, 20.0f));
 float lastX = SCR_WIDTH / 2.0f;
@@ -52,18 +62,21 @@ bool firstMouse = true;
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
 
-Shader genShader(string fname, string glitterDir) {
-    string vertexShader = glitterDir + "\\Shaders\\" + fname + ".vs";
-    string fragShader = glitterDir + "\\Shaders\\" + fname + ".fs";
-    return Shader(vertexShader.c_str(), fragShader.c_str());
-}
-
 int main(int argc, char * argv[]) {
 
+    // offline texture bake: Glitter --compress-textures [--normal] <image>...
+    // writes the block compressed <image>.ktx caches the loader picks up, no window needed
+    if (argc > 1 && string(argv[1]) == "--compress-textures")
+        return compressTextures(argc - 2, argv + 2);
+
     std::string p = argv[0]; // Name of the current exec program
 
-    // retrieve the directory path of the filepath
-    string glitterDir = p.substr(0, p.find_last_of('\\'));
+    // retrieve the directory path of the filepath, either separator
+    string glitterDir = BatchRenderer::directoryOf(p);
+
+    // headless batch: Glitter --batch <manifest>, renders the images it lists without a window
+    if (argc > 1 && string(argv[1]) == "--batch")
+        return renderBatch(argc - 2, argv + 2, glitterDir);
 
     // Load GLFW and Create a Window
     glfwInit();
@@ -71,7 +84,7 @@ int main(int argc, char * argv[]) {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
     auto mWindow = glfwCreateWindow(mWidth, mHeight, "OpenGL", nullptr, nullptr);
     // Check for Valid Context
     if (mWindow == nullptr) {
@@ -94,266 +107,125 @@ int main(int argc, char * argv[]) {
         return -1;
     }
 
-    stbi_set_flip_vertically_on_load(true);
+    TextureStreamer::instance().setFlipVertically(true);
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // add extra depth/normal framebuffers
-    // used for silhouetteing
-    // -----------------------------
-    TextureBuffer normalBuff = TextureBuffer(SCR_WIDTH, SCR_HEIGHT, true);
-    TextureBuffer depthBuff = TextureBuffer(SCR_WIDTH, SCR_HEIGHT, true);
-    TextureBuffer normalEdgeBuff = TextureBuffer(SCR_WIDTH, SCR_HEIGHT, true);
-    TextureBuffer depthEdgeBuff = TextureBuffer(SCR_WIDTH, SCR_HEIGHT, true);
-
     // set glitter dir and shader locations
     // ------------------------------------
     // only set manually if building from source files!
     // string glitterDir = "C:\\Users\\gusca\\Desktop\\graph final\\Glitter\\Glitter";
+    string shaderDir = glitterDir + "/Shaders";
 
-    // build and compile our shader programs
-    // ------------------------------------
-    Shader ourShader = genShader("model", glitterDir);
-    Shader silNormalShader = genShader("silNormal", glitterDir);
-    Shader silDepthShader = genShader("silDepth", glitterDir);
-    Shader normalShader = genShader("normal", glitterDir);
-    Shader depthShader = genShader("depth", glitterDir);
-    Shader diffuseShader = genShader("diffuse", glitterDir);
-    Shader quadShader = genShader("quad", glitterDir);
-
-    // load models
-    // -----------
-    string modelObj = "\\resources\\A-Wing Starfighter.obj";
-    //string modelObj = "\\resources\\teapot\\teapot_n_glass.obj";
-    Model ourModel((glitterDir + modelObj).c_str());
-
-    // load control texture
-    // -----------
-    string path = glitterDir + "\\resources\\controls.jpg";
-    unsigned int con;
-    glGenTextures(1, &con);
-    glBindTexture(GL_TEXTURE_2D, con);
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load and generate the texture
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-    // Create Context and Load OpenGL Functions
-    glfwMakeContextCurrent(mWindow);
-    gladLoadGL();
-    fprintf(stderr, "OpenGL %s\n", glGetString(GL_VERSION));
-
-    float quadVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates. NOTE that this plane is now much smaller and at the top of the screen
-        // positions   // texCoords
-        -1.0f,  1.0f,  0.0f, 1.0f,
-        -1.0f, -1.0f,  0.0f, 0.0f,
-         1.0f, -1.0f,  1.0f, 0.0f,
-
-        -1.0f,  1.0f,  0.0f, 1.0f,
-         1.0f, -1.0f,  1.0f, 0.0f,
-         1.0f,  1.0f,  1.0f, 1.0f
-    };
-
-    // screen quad VAO
-    unsigned int quadVAO, quadVBO;
-    glGenVertexArrays(1, &quadVAO);
-    glGenBuffers(1, &quadVBO);
-    glBindVertexArray(quadVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-
-    float conVertices[] = { // vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates. NOTE that this plane is now much smaller and at the top of the screen
-        // positions   // texCoords
-        -1.0f,  1.0f,  0.0f, 1.0f,
-        -1.0f, -1.0f,  0.0f, 0.0f,
-         1.0f, -1.0f,  1.0f, 0.0f,
-
-        -1.0f,  1.0f,  0.0f, 1.0f,
-         1.0f, -1.0f,  1.0f, 0.0f,
-         1.0f,  1.0f,  1.0f, 1.0f
-    };
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(mWindow))
+    // everything that holds GL objects lives in this block, so it's destroyed while the context is current
     {
-        glEnable(GL_DEPTH_TEST);
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(mWindow);
+        // build and compile our shader programs, and the passes of a frame
+        // ------------------------------------
+        SceneRenderer renderer(shaderDir);
+        // follows the window, scaled to hold the frame budget
+        ResolutionGovernor governor;
+        // screenshots and videos next to the executable, encoded in the background
+        FrameCapture capture;
+        int screenshots = 0, recordings = 0;
+
+        // load models
+        // -----------
+        string modelObj = "/resources/A-Wing Starfighter.obj";
+        //string modelObj = "/resources/teapot/teapot_n_glass.obj";
+        // loads in the background, the render loop streams it in and draws a box in its place meanwhile
+        AsyncModel ourModel((glitterDir + modelObj).c_str());
+
+        // load control texture
+        // -----------
+        string path = glitterDir + "/resources/controls.jpg";
+        // decoded in the background and streamed in by the per-frame update below
+        renderer.setControls(TextureStreamer::instance().load(path));
+
+        // Create Context and Load OpenGL Functions
+        glfwMakeContextCurrent(mWindow);
+        gladLoadGL();
+        fprintf(stderr, "OpenGL %s\n", glGetString(GL_VERSION));
+
+        // render loop
+        // -----------
+        int lastWidth = 0, lastHeight = 0;
+        while (!glfwWindowShouldClose(mWindow))
+        {
+            // per-frame time logic
+            // --------------------
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // input
+            // -----
+            processInput(mWindow);
+
+            // nothing to draw into while minimized
+            int width, height;
+            glfwGetFramebufferSize(mWindow, &width, &height);
+            if (width == 0 || height == 0)
+            {
+                glfwWaitEvents();
+                continue;
+            }
+            renderer.graph.setRenderScale(governor.update());
+
+            // upload whatever textures finished decoding, within this frame's budget
+            TextureStreamer::instance().update();
+
+            // mesh uploads within their own budget, the batch follows whenever the proxy or the model appears
+            ourModel.update();
+            renderer.setScene(ourModel.ready() ? ourModel.model() : ourModel.proxy());
+            ourModel.releaseProxy();
         
-        // set up MVP matrices
-        // model matrix
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); 
-        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));	
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-
-        // render depth and normal textures
-        // -----
-        glBindFramebuffer(GL_FRAMEBUFFER, normalBuff.FBO);
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        silNormalShader.use();
-        silNormalShader.setMat4("projection", projection);
-        silNormalShader.setMat4("view", view);
-        silNormalShader.setMat4("model", model);
-
-        ourModel.DrawToBuffer(silNormalShader);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, depthBuff.FBO);
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        silDepthShader.use();
-        silDepthShader.setMat4("projection", projection);
-        silDepthShader.setMat4("view", view);
-        silDepthShader.setMat4("model", model);
-
-        ourModel.DrawToBuffer(silDepthShader);
-
-        // process depth and normal for outlines
-        // -----
-        glBindFramebuffer(GL_FRAMEBUFFER, normalEdgeBuff.FBO);
-        glDisable(GL_DEPTH_TEST);
-        normalShader.use();
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, normalBuff.tex);	
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, depthEdgeBuff.FBO);
-        glDisable(GL_DEPTH_TEST);
-        depthShader.use();
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, depthBuff.tex);	
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // render to main frame
-        // ------
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        switch (renderPassFlags) {
-            case 0:
-                glEnable(GL_DEPTH_TEST);
-
-                // don't forget to enable shader before setting uniforms
-                ourShader.use();
-
-                // update light direction for hue
-                ourShader.setVec3("aLightDir", camera.Right);
-
-                // hue colors and weights
-                ourShader.setVec3("hue.cool", hue.cool);
-                ourShader.setVec3("hue.warm", hue.warm);
-                ourShader.setFloat("hue.alpha", hue.alpha);
-                ourShader.setFloat("hue.beta", hue.beta);
-
-                // view/projection transformations
-                ourShader.setMat4("projection", projection);
-                ourShader.setMat4("view", view);
-                ourShader.setMat4("model", model);
-
-                ourModel.Draw(ourShader);
-                break;
-            case 1:
-                glDisable(GL_DEPTH_TEST);
-                quadShader.use();
-
-                glBindTexture(GL_TEXTURE_2D, normalEdgeBuff.tex);
-
-                glBindVertexArray(quadVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                break;
-            case 2:
-                glDisable(GL_DEPTH_TEST);
-                quadShader.use();
-
-                glBindTexture(GL_TEXTURE_2D, depthEdgeBuff.tex);
-
-                glBindVertexArray(quadVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                break;
-
-            case 3:
-                glDisable(GL_DEPTH_TEST);
-                quadShader.use();
-
-                glBindTexture(GL_TEXTURE_2D, normalBuff.tex);
-
-                glBindVertexArray(quadVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                break;
-
-            case 4:
-                glDisable(GL_DEPTH_TEST);
-                quadShader.use();
-
-                glBindTexture(GL_TEXTURE_2D, depthBuff.tex);
-
-                glBindVertexArray(quadVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                break;
-            case 5:
-                glEnable(GL_DEPTH_TEST);
-                diffuseShader.use();
-                // view/projection transformations
-                diffuseShader.setMat4("projection", projection);
-                diffuseShader.setMat4("view", view);
-                diffuseShader.setMat4("model", model);
-
-                ourModel.Draw(diffuseShader);
-                break;
-            case 6:
-                glDisable(GL_DEPTH_TEST);
-                quadShader.use();
-
-                glBindTexture(GL_TEXTURE_2D, con);
-
-                glBindVertexArray(quadVAO);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                break;
-
-            default:
-                break;
+            // set up MVP matrices
+            // model matrix
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); 
+            model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));	
+
+            governor.begin();
+            renderer.render(renderPassFlags, model, camera, hue, width, height);
+            governor.end();
+
+            // the back buffer before it's swapped. videos are 4:2:0 and need an even size, and end with a resize.
+            if (screenshotRequested)
+                capture.capture(0, width, height, glitterDir + "/screenshot" + to_string(screenshots++) + ".png");
+            if (recordingToggled && capture.recording())
+                capture.closeVideo();
+            else if (recordingToggled)
+                capture.openVideo(glitterDir + "/recording" + to_string(recordings++) + ".y4m", width & ~1, height & ~1, 60);
+            if (capture.recording())
+            {
+                if (!recordingToggled && (lastWidth != width || lastHeight != height))
+                    capture.closeVideo();
+                else
+                    capture.capture(0, width & ~1, height & ~1, "", CAPTURE_Y4M);
+            }
+            screenshotRequested = recordingToggled = false;
+            lastWidth = width;
+            lastHeight = height;
+            capture.poll();
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(mWindow);
+            glfwPollEvents();
         }
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(mWindow);
-        glfwPollEvents();
+        TextureCache::instance().report();
+        GLState::instance().report();
+        renderer.graph.report();
+        governor.report();
+        capture.closeVideo();
+        capture.finish();
+        capture.report();
     }
+    TextureCache::instance().shutdown();
+    TextureStreamer::instance().release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -400,6 +272,15 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
         processRender(GLFW_KEY_E);
 
+    // capture, on the press only
+    static bool screenshotHeld = false, recordHeld = false;
+    bool screenshotKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    bool recordKey = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+    screenshotRequested |= screenshotKey && !screenshotHeld;
+    recordingToggled |= recordKey && !recordHeld;
+    screenshotHeld = screenshotKey;
+    recordHeld = recordKey;
+
     // control Hue alpha
     if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
         hue.alpha = min(hue.alpha + 0.001f, 1.0f);
@@ -413,6 +294,74 @@ void processInput(GLFWwindow* window)
         hue.beta = max(hue.beta - 0.001f, 0.0f);
 }
 
+// bakes the compressed texture caches for the given images. --normal marks the images after it as normal maps.
+// ---------------------------------------------------------------------------------------------------------
+int compressTextures(int count, char* files[])
+{
+    // same orientation the renderer loads with, it's part of the cache key
+    stbi_set_flip_vertically_on_load(true);
+
+    bool normalMap = false;
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        string file = files[i];
+        if (file == "--normal")
+        {
+            normalMap = true;
+            continue;
+        }
+        if (TextureCompressor::compressFile(file, normalMap, true))
+            std::cout << "compressed " << TextureCompressor::cachePath(file) << std::endl;
+        else
+        {
+            std::cout << "failed to compress " << file << std::endl;
+            failed++;
+        }
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// renders the images of a manifest (see BatchRenderer.h) on a surfaceless context, no window or display needed
+// ---------------------------------------------------------------------------------------------------------
+int renderBatch(int count, char* args[], const string& glitterDir)
+{
+#ifdef GLITTER_HEADLESS
+    if (count != 1)
+    {
+        std::cout << "usage: Glitter --batch <manifest>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    BatchRenderer batch;
+    if (!batch.load(args[0]))
+        return EXIT_FAILURE;
+    HeadlessContext context;
+    if (!context.create())
+        return EXIT_FAILURE;
+    fprintf(stderr, "OpenGL %s, %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+    TextureStreamer::instance().setFlipVertically(true);
+
+    int failed;
+    {
+        SceneRenderer renderer(glitterDir + "/Shaders");
+        FrameCapture capture;
+        failed = batch.run(renderer, hue, capture);
+        TextureCache::instance().report();
+        renderer.graph.report();
+        capture.report();
+    }
+    TextureCache::instance().shutdown();
+    TextureStreamer::instance().release();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+    (void)count;
+    (void)args;
+    (void)glitterDir;
+    std::cout << "ERROR::BATCH:: built without GLITTER_HEADLESS, there's no headless context" << std::endl;
+    return EXIT_FAILURE;
+#endif
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
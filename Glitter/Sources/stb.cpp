@@ -0,0 +1,7 @@
+// Preprocessor Directives
+#define STB_DXT_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+// System Headers
+#include <stb_dxt.h>
+#include <stb_image_write.h>
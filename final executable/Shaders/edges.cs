@@ -0,0 +1,88 @@
+#version 430 core
+// the same edges as edges.fs, a 16x16 tile per work group. the tile and a one texel border around it
+// are fetched once into shared memory and every invocation reads its 9 neighbours from there.
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// r: normal edges, g: depth edges
+layout (rg8, binding = 0) uniform writeonly image2D edges;
+
+// written by the geometry pass (see GBuffer.h)
+uniform sampler2D faceNormals;
+uniform sampler2D depths;
+
+const int TILE = 16;
+const int APRON = TILE + 2;
+
+shared vec3 normalTile[APRON * APRON];
+shared float depthTile[APRON * APRON];
+
+float near = 0.1; 
+float far  = 100.0; 
+
+// the depth buffer's value as linear depth over far, as the geometry pass used to write it
+float linearDepth(float depth) 
+{
+    float z = depth * 2.0 - 1.0; // back to NDC 
+    return (2.0 * near * far) / (far + near - z * (far - near)) / far;
+}
+
+// the G-buffer's octahedral normals back to unit vectors, zero where nothing was drawn
+vec3 decodeNormal(vec2 encoded)
+{
+    if (encoded == vec2(0.0))
+        return vec3(0.0);
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 size = textureSize(faceNormals, 0);
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - 1;
+
+    // texels outside the target read as the border color, as the clamped samples of edges.fs do
+    for (int i = int(gl_LocalInvocationIndex); i < APRON * APRON; i += TILE * TILE)
+    {
+        ivec2 p = origin + ivec2(i % APRON, i / APRON);
+        bool inside = all(greaterThanEqual(p, ivec2(0))) && all(lessThan(p, size));
+        normalTile[i] = inside ? decodeNormal(texelFetch(faceNormals, p, 0).xy) : vec3(0.0);
+        depthTile[i] = inside ? linearDepth(texelFetch(depths, p, 0).r) : 0.0;
+    }
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, size)))
+        return;
+
+    // sobel on the normals, both directions summed, and laplacian on the depth. rows go top to
+    // bottom like edges.fs, top being +y in texture space.
+    float sobel[9] = float[](
+        -2, -2,  0,
+        -2,  0,  2,
+         0,  2,  2
+    );
+    float kernel[9] = float[](
+        -1, -1, -1,
+        -1,  8, -1,
+        -1, -1, -1
+    );
+
+    ivec2 center = ivec2(gl_LocalInvocationID.xy) + 1;
+    vec3 normalSum = vec3(0.0);
+    float depthSum = 0.0;
+    for (int i = 0; i < 9; i++)
+    {
+        ivec2 t = center + ivec2(i % 3 - 1, 1 - i / 3);
+        normalSum += normalTile[t.y * APRON + t.x] * sobel[i];
+        depthSum += depthTile[t.y * APRON + t.x] * kernel[i];
+    }
+
+    // the depth threshold was tuned on three equal channels, hence the sqrt(3)
+    float normalEdge = length(normalSum) > .8 ? 1.0 : 0.0;
+    float depthEdge = abs(depthSum) * sqrt(3.0) > .5 ? 1.0 : 0.0;
+    imageStore(edges, pixel, vec4(normalEdge, depthEdge, 0.0, 0.0));
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aFaceNormal;
+
+out vec2 TexCoords;
+out vec3 normal;
+out vec3 faceNormal;
+
+// shared by every program, updated once per frame (see UniformBlocks.h)
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 aLightDir;
+};
+uniform mat4 model;
+// undoes the mesh's position quantization, identity for float positions
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+void main()
+{
+    TexCoords = aTexCoords;
+    normal = normalize(aNormal);
+    faceNormal = aFaceNormal;
+    gl_Position = projection * view * model * vec4(aPos * positionScale + positionOffset, 1.0);
+}
\ No newline at end of file